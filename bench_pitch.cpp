@@ -0,0 +1,519 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: bench_pitch.cpp      pitch tracker benchmark
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "./gx_pitch_tracker.h"
+#include "./gx_signalgen.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include <vector>
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// time one autocorrelation the way AcfEstimator::autocorrelation_fft()
+// does it, for the fft size the given padding mode picks.
+static double bench_fft(int buffersize, int padding, int *size) {
+    const int iterations = 2000;
+    int n = PitchTracker::fft_size(buffersize, padding);
+    float *input = new float[buffersize];
+    float *t = reinterpret_cast<float*>(fftwf_malloc(n * sizeof(float)));
+    float *f = reinterpret_cast<float*>(fftwf_malloc(n * sizeof(float)));
+    fftwf_plan fft = fftwf_plan_r2r_1d(n, t, f, FFTW_R2HC, FFTW_MEASURE);
+    fftwf_plan ifft = fftwf_plan_r2r_1d(n, f, t, FFTW_HC2R, FFTW_MEASURE);
+    for (int k = 0; k < buffersize; k++) {
+        input[k] = static_cast<float>(rand()) / RAND_MAX - 0.5;
+    }
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        memcpy(t, input, buffersize * sizeof(float));
+        memset(t + buffersize, 0, (n - buffersize) * sizeof(float));
+        fftwf_execute(fft);
+        for (int k = 1; k < n/2; k++) {
+            f[k] = f[k] * f[k] + f[n-k] * f[n-k];
+            f[n-k] = 0.0;
+        }
+        f[0] = f[0] * f[0];
+        f[n/2] = f[n/2] * f[n/2];
+        fftwf_execute(ifft);
+    }
+    double ns = (now_ns() - start) / iterations;
+    fftwf_destroy_plan(fft);
+    fftwf_destroy_plan(ifft);
+    fftwf_free(t);
+    fftwf_free(f);
+    delete[] input;
+    *size = n;
+    return ns;
+}
+
+// the pre-filter with each instruction set the cpu has, against the
+// scalar version on white noise and on an impulse (its impulse response,
+// so the frequency response is the same when it matches). The simd
+// versions lag by delay() samples. Prints the time per jack period and
+// the largest difference, false when one is above PREFILTER_MAX_DIFF.
+static const int PREFILTER_LENGTH = 48000;
+static const double PREFILTER_MAX_DIFF = 1e-5;
+
+static bool bench_prefilter(int fs, int period) {
+    static const char *names[] = { "scalar", "sse2", "avx2" };
+    const int n = PREFILTER_LENGTH;
+    std::vector<float> input[2];
+    std::vector<float> reference[2];
+    input[0].resize(n);
+    input[1].assign(n, 0.0f);
+    srand(1);
+    for (int i = 0; i < n; i++) {
+        input[0][i] = static_cast<float>(rand()) / RAND_MAX - 0.5;
+    }
+    input[1][0] = 1.0;
+    bool ok = true;
+    for (int s = Dsp::SIMD_NONE; s <= Dsp::SIMD_AVX2; s++) {
+        Dsp dsp;
+        dsp.init(fs, s);
+        if (dsp.simd() != s) {
+            printf("%8d %8s %10s\n", fs, names[s], "n/a");
+            continue;
+        }
+        double ns = 0.0;
+        double diff[2] = { 0.0, 0.0 };
+        for (int k = 0; k < 2; k++) {
+            std::vector<float> in = input[k];
+            std::vector<float> out(n);
+            dsp.clear_state_f();
+            double start = now_ns();
+            for (int i = 0; i < n; i += period) {
+                dsp.compute(std::min(period, n - i), &in[i], &out[i]);
+            }
+            if (k == 0) {
+                ns = (now_ns() - start) * period / n;
+            }
+            if (s == Dsp::SIMD_NONE) {
+                reference[k] = out;
+            }
+            const int delay = dsp.delay();
+            for (int i = 0; i + delay < n; i++) {
+                diff[k] = std::max(diff[k], fabs(static_cast<double>(out[i + delay]) -
+                                                 reference[k][i]));
+            }
+            if (diff[k] > PREFILTER_MAX_DIFF) {
+                ok = false;
+            }
+        }
+        printf("%8d %8s %10.0f %12.3g %12.3g\n", fs, names[s], ns, diff[0], diff[1]);
+    }
+    return ok;
+}
+
+// time the rate conversion of one jack period into the analysis rate,
+// by the half-band decimator where the rate allows it, and by the
+// resampler the tracker used before.
+static void bench_rate(int fs, int period, double *dec_ns, double *res_ns) {
+    const int iterations = 20000;
+    const int target = 20500;
+    float *input = new float[period];
+    float *output = new float[period];
+    for (int k = 0; k < period; k++) {
+        input[k] = static_cast<float>(rand()) / RAND_MAX - 0.5;
+    }
+    Decimator dec;
+    *dec_ns = 0;
+    if (dec.setup(fs, target)) {
+        double start = now_ns();
+        for (int i = 0; i < iterations; i++) {
+            memcpy(output, input, period * sizeof(float));
+            dec.process(period, output, output);
+        }
+        *dec_ns = (now_ns() - start) / iterations;
+    }
+    Resampler resamp;
+    resamp.setup(fs, target, 1, 16);
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        resamp.inp_count = period;
+        resamp.inp_data = input;
+        resamp.out_count = period;
+        resamp.out_data = output;
+        resamp.process();
+    }
+    *res_ns = (now_ns() - start) / iterations;
+    delete[] input;
+    delete[] output;
+}
+
+// plucked string like test tone: harmonics falling off with 1/h, a
+// weak fundamental and some noise
+static void make_tone(float *out, int size, double freq, int fs) {
+    static const double amp[] = { 0.3, 1.0, 0.6, 0.45, 0.3, 0.2, 0.15, 0.1 };
+    for (int j = 0; j < size; j++) {
+        double v = 0.0;
+        for (int h = 1; h <= 8 && h * freq < fs / 2; h++) {
+            v += amp[h-1] * sin(2 * M_PI * h * freq * j / fs + h);
+        }
+        out[j] = 0.1 * v + 0.002 * (static_cast<float>(rand()) / RAND_MAX - 0.5);
+    }
+}
+
+// run one estimator over tones across the guitar range, each detuned
+// by up to 50 cents, and report time per estimate and error in cents.
+// An estimate more than 50 cents off counts as a miss.
+static void bench_estimator(const char *name, int fs, int size) {
+    static const double notes[] = { 41.2, 55.0, 82.41, 110.0, 146.8, 196.0,
+                                    246.9, 329.6, 440.0, 659.3, 987.8 };
+    const int rounds = 20;
+    PitchEstimator *e = PitchEstimator::create(name);
+    e->setup(&size, 1, PitchEstimator::FFT_PAD_SMOOTH);
+    float *input = new float[size];
+    double *energy = new double[size];
+    double ns = 0.0, sum = 0.0, worst = 0.0;
+    int hits = 0, misses = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (unsigned int i = 0; i < sizeof(notes) / sizeof(notes[0]); i++) {
+            double freq = notes[i] * pow(2.0, (rand() % 101 - 50) / 1200.0);
+            make_tone(input, size, freq, fs);
+            double e2 = 0.0;
+            for (int j = 0; j < size; j++) {
+                e2 += input[j] * input[j];
+                energy[j] = e2;
+            }
+            AnalysisWindow w = { input, size, energy, e2, fs, 30.0, 1060.0 };
+            float clarity;
+            double start = now_ns();
+            float x = e->estimate(w, &clarity);
+            ns += now_ns() - start;
+            double cents = (x > 0) ? fabs(1200 * log2(x / freq)) : 1e9;
+            if (cents > 50) {
+                misses++;
+                continue;
+            }
+            hits++;
+            sum += cents;
+            if (cents > worst) {
+                worst = cents;
+            }
+        }
+    }
+    int n = rounds * sizeof(notes) / sizeof(notes[0]);
+    printf("%10s %10.0f %10.2f %10.2f %6d/%d\n", name, ns / n,
+           hits ? sum / hits : 0.0, worst, misses, n);
+    delete[] input;
+    delete[] energy;
+    delete e;
+}
+
+// feed seconds of a test signal period by period into a tracker, and
+// run the analysis steps the analysis thread would run after each
+// period. Reports the cost of add() per period and of one analysis,
+// and how many such channels one core keeps up with in realtime.
+static void bench_tracker(int kind, int fs, int period, double seconds) {
+    const double freq = 110.0;
+    const double inharmonicity = (kind == SignalGen::SAW) ? 1e-4 : 0.0;
+    SignalGen gen;
+    gen.setup(kind, freq, fs, inharmonicity);
+    PitchTracker pt;
+    pt.set_threaded(false);
+    pt.set_max_period(period);
+    pt.init(fs, pthread_self());
+    float *input = new float[period];
+    int periods = static_cast<int>(seconds * fs / period);
+    double add_ns = 0.0, analyse_ns = 0.0;
+    int analyses = 0;
+    unsigned int frame = 0;
+    for (int p = 0; p < periods; p++) {
+        gen.generate(period, input);
+        double start = now_ns();
+        pt.add(period, input, frame);
+        add_ns += now_ns() - start;
+        frame += period;
+        for (;;) {
+            start = now_ns();
+            bool done = pt.analyse();
+            if (!done) {
+                break;
+            }
+            analyse_ns += now_ns() - start;
+            analyses++;
+        }
+    }
+    double cpu = (add_ns + analyse_ns) * 1e-9;
+    printf("%8s %8d %8d %10.0f %10d %10.0f %10.0f\n", SignalGen::name(kind), fs, period,
+           add_ns / periods, analyses, analyses ? analyse_ns / analyses : 0.0,
+           cpu > 0.0 ? periods * static_cast<double>(period) / fs / cpu : 0.0);
+    delete[] input;
+}
+
+// corpus of the accuracy check
+static const int ACC_RATE = 48000;
+static const int ACC_PERIOD = 256;
+// every semitone from B0 (30.9 Hz) to B5 (987.8 Hz), midi note numbers
+static const int ACC_FIRST_NOTE = 23;
+static const int ACC_LAST_NOTE = 83;
+static const double ACC_TONE_TIME = 1.0;
+static const double ACC_GAP_TIME = 0.5;
+// an estimate is stable when it and the next STABLE_ESTIMATES-1 ones
+// are within STABLE_CENTS of the tone
+static const int STABLE_ESTIMATES = 3;
+static const double STABLE_CENTS = 10.0;
+// estimates further off are errors, octave errors or gross ones
+static const double ERROR_CENTS = 50.0;
+
+// limits per signal to noise ratio, a bit above what the tracker does
+// now. Tighten them when the tracker gets better. Most gross errors
+// come from the analysis right at the onset, on a window which holds
+// little of the tone yet.
+struct AccuracyLimits {
+    double          snr_db;
+    // error of the estimates from the first stable one on (cents)
+    double          cents_avg;
+    double          cents_max;
+    // octave errors and other errors among all estimates of the tones
+    double          octave_rate;
+    double          gross_rate;
+    // tones without a stable estimate
+    int             unstable;
+    // time from the start of the tone to the first stable estimate (s)
+    double          settle_avg;
+    double          settle_max;
+};
+
+static const AccuracyLimits limits[] = {
+    { 40, 0.7, 12.0, 0.005, 0.05, 0, 0.04, 0.08 },
+    { 20, 0.9, 12.0, 0.005, 0.05, 0, 0.04, 0.08 },
+    { 10, 1.5, 12.0, 0.04,  0.05, 2, 0.05, 0.15 },
+};
+
+struct AccuracyStats {
+    int             tones;
+    int             unstable;
+    int             estimates;
+    int             octaves;
+    int             gross;
+    double          cents_sum;
+    int             cents_count;
+    double          cents_max;
+    double          settle_sum;
+    double          settle_max;
+};
+
+// play one tone after a gap of silence and collect the estimates: the
+// time until the first stable one, the error of the estimates from
+// there on, and the octave and gross errors of all of them
+static void accuracy_tone(PitchTracker *pt, double freq, double snr_db,
+                          unsigned int *frame, AccuracyStats *st) {
+    SignalGen tone, noise;
+    tone.setup(SignalGen::SAW, freq, ACC_RATE);
+    noise.setup(SignalGen::NOISE, 0, ACC_RATE);
+    // the saw has an rms of about 0.3 * 0.55 / sqrt(2), white noise of
+    // level l one of l / sqrt(3)
+    double tone_rms = 0.3 * 0.55 / sqrt(2.0);
+    noise.set_level(tone_rms * sqrt(3.0) * pow(10.0, -snr_db / 20));
+    float input[ACC_PERIOD], n[ACC_PERIOD];
+    int gap = static_cast<int>(ACC_GAP_TIME * ACC_RATE / ACC_PERIOD);
+    int periods = gap + static_cast<int>(ACC_TONE_TIME * ACC_RATE / ACC_PERIOD);
+    std::vector<double> cents;
+    std::vector<double> times;
+    for (int p = 0; p < periods; p++) {
+        if (p < gap) {
+            memset(input, 0, sizeof(input));
+        } else {
+            tone.generate(ACC_PERIOD, input);
+            noise.generate(ACC_PERIOD, n);
+            for (int j = 0; j < ACC_PERIOD; j++) {
+                input[j] += n[j];
+            }
+        }
+        pt->add(ACC_PERIOD, input, *frame);
+        *frame += ACC_PERIOD;
+        while (pt->analyse()) {
+            PitchResult r;
+            pt->get_result(&r);
+            if (p < gap || r.freq <= 0) {
+                continue;
+            }
+            cents.push_back(1200 * log2(r.freq / freq));
+            times.push_back(static_cast<double>(p - gap + 1) * ACC_PERIOD / ACC_RATE);
+        }
+    }
+    st->tones++;
+    st->estimates += cents.size();
+    for (unsigned int i = 0; i < cents.size(); i++) {
+        double c = fabs(cents[i]);
+        if (c > 600 && fabs(c - 1200 * round(c / 1200)) < ERROR_CENTS) {
+            st->octaves++;
+        } else if (c > ERROR_CENTS) {
+            st->gross++;
+        }
+    }
+    unsigned int stable = 0;
+    int run = 0;
+    while (stable + run < cents.size() && run < STABLE_ESTIMATES) {
+        if (fabs(cents[stable + run]) < STABLE_CENTS) {
+            run++;
+        } else {
+            stable += run + 1;
+            run = 0;
+        }
+    }
+    if (run < STABLE_ESTIMATES) {
+        st->unstable++;
+        return;
+    }
+    st->settle_sum += times[stable];
+    if (times[stable] > st->settle_max) {
+        st->settle_max = times[stable];
+    }
+    for (unsigned int i = stable; i < cents.size(); i++) {
+        double c = fabs(cents[i]);
+        if (c > ERROR_CENTS) {
+            continue;
+        }
+        st->cents_sum += c;
+        st->cents_count++;
+        if (c > st->cents_max) {
+            st->cents_max = c;
+        }
+    }
+}
+
+// every semitone of the range, detuned by -50 .. 50 cents, as a
+// sawtooth in white noise at several signal to noise ratios. Returns
+// false when a limit is exceeded.
+static bool check_accuracy() {
+    static const double detune[] = { -50, -25, 0, 25, 50 };
+    bool ok = true;
+    printf("pitch tracker accuracy, notes %d .. %d, detuned by -50 .. 50 cents\n",
+           ACC_FIRST_NOTE, ACC_LAST_NOTE);
+    printf("%6s %6s %10s %10s %10s %10s %10s %10s %10s\n", "snr dB", "tones",
+           "cents avg", "cents max", "octave %", "gross %", "unstable",
+           "settle avg", "settle max");
+    for (unsigned int s = 0; s < sizeof(limits) / sizeof(limits[0]); s++) {
+        const AccuracyLimits& l = limits[s];
+        AccuracyStats st;
+        memset(&st, 0, sizeof(st));
+        PitchTracker pt;
+        pt.set_threaded(false);
+        pt.set_max_period(ACC_PERIOD);
+        pt.init(ACC_RATE, pthread_self());
+        unsigned int frame = 0;
+        for (int note = ACC_FIRST_NOTE; note <= ACC_LAST_NOTE; note++) {
+            for (unsigned int d = 0; d < sizeof(detune) / sizeof(detune[0]); d++) {
+                double freq = 440.0 * pow(2.0, (note - 69 + detune[d] / 100) / 12);
+                accuracy_tone(&pt, freq, l.snr_db, &frame, &st);
+            }
+        }
+        double avg = st.cents_count ? st.cents_sum / st.cents_count : 0.0;
+        double octave = st.estimates ? static_cast<double>(st.octaves) / st.estimates : 0.0;
+        double gross = st.estimates ? static_cast<double>(st.gross) / st.estimates : 0.0;
+        int stable = st.tones - st.unstable;
+        double settle = stable ? st.settle_sum / stable : 0.0;
+        printf("%6.0f %6d %10.2f %10.2f %10.2f %10.2f %10d %10.3f %10.3f\n",
+               l.snr_db, st.tones, avg, st.cents_max, 100 * octave, 100 * gross,
+               st.unstable, settle, st.settle_max);
+        printf("%6s %6s %10.2f %10.2f %10.2f %10.2f %10d %10.3f %10.3f\n",
+               "limit", "", l.cents_avg, l.cents_max, 100 * l.octave_rate,
+               100 * l.gross_rate, l.unstable, l.settle_avg, l.settle_max);
+        if (avg > l.cents_avg || st.cents_max > l.cents_max ||
+            octave > l.octave_rate || gross > l.gross_rate ||
+            st.unstable > l.unstable || settle > l.settle_avg ||
+            st.settle_max > l.settle_max) {
+            ok = false;
+        }
+    }
+    printf("%s\n", ok ? "accuracy ok" : "accuracy REGRESSION");
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    // --accuracy only runs the accuracy check, the exit status tells
+    // whether it passed
+    if (argc > 1 && strcmp(argv[1], "--accuracy") == 0) {
+        printf("pre-filter, simd against scalar\n");
+        printf("%8s %8s %10s %12s %12s\n", "rate", "simd", "ns", "noise diff", "impulse diff");
+        bool ok = bench_prefilter(48000, 256);
+        printf("%s\n\n", ok ? "pre-filter ok" : "pre-filter MISMATCH");
+        return (check_accuracy() && ok) ? 0 : 1;
+    }
+    static const int windows[] = { 700, 1024, 1500, 2048, 2900, 4096 };
+    static const char *names[] = { "min", "smooth", "pow2" };
+
+    printf("autocorrelation fft, ns per analysis window\n");
+    printf("%8s", "window");
+    for (int p = PitchTracker::FFT_PAD_MIN; p <= PitchTracker::FFT_PAD_POW2; p++) {
+        printf(" %8s %10s", names[p], "ns");
+    }
+    printf("\n");
+    for (unsigned int w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+        printf("%8d", windows[w]);
+        for (int p = PitchTracker::FFT_PAD_MIN; p <= PitchTracker::FFT_PAD_POW2; p++) {
+            int size;
+            double ns = bench_fft(windows[w], p, &size);
+            printf(" %8d %10.0f", size, ns);
+        }
+        printf("\n");
+    }
+
+    static const int rates[] = { 44100, 48000, 88200, 96000, 176400, 192000 };
+    const int period = 256;
+    printf("\npre-filter, ns per jack period of %d frames, difference to scalar\n", period);
+    printf("%8s %8s %10s %12s %12s\n", "rate", "simd", "ns", "noise diff", "impulse diff");
+    for (unsigned int r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        bench_prefilter(rates[r], period);
+    }
+
+    printf("\nrate conversion, ns per jack period of %d frames\n", period);
+    printf("%8s %8s %10s %10s\n", "rate", "factor", "decimator", "resampler");
+    for (unsigned int r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        Decimator dec;
+        double dec_ns, res_ns;
+        bench_rate(rates[r], period, &dec_ns, &res_ns);
+        printf("%8d %8d %10.0f %10.0f\n", rates[r], dec.setup(rates[r], 20500),
+               dec_ns, res_ns);
+    }
+
+    static const char *estimators[] = { "nsdf", "yin", "hps", "cepstrum" };
+    const int fs = 24000, window = 2048;
+    printf("\npitch estimators at %d Hz, window %d\n", fs, window);
+    printf("%10s %10s %10s %10s %8s\n", "estimator", "ns", "cents avg", "cents max", "misses");
+    for (unsigned int i = 0; i < sizeof(estimators) / sizeof(estimators[0]); i++) {
+        bench_estimator(estimators[i], fs, window);
+    }
+
+    static const int tracker_rates[] = { 44100, 48000, 96000 };
+    static const int periods[] = { 64, 256, 1024 };
+    const double seconds = 5.0;
+    printf("\npitch tracker, 110 Hz, %.0f s of input per run\n", seconds);
+    printf("%8s %8s %8s %10s %10s %10s %10s\n", "signal", "rate", "period",
+           "add ns", "analyses", "ns", "channels");
+    for (int kind = 0; kind < SignalGen::KINDS; kind++) {
+        for (unsigned int r = 0; r < sizeof(tracker_rates) / sizeof(tracker_rates[0]); r++) {
+            for (unsigned int p = 0; p < sizeof(periods) / sizeof(periods[0]); p++) {
+                bench_tracker(kind, tracker_rates[r], periods[p], seconds);
+            }
+        }
+    }
+    return 0;
+}
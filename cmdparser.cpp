@@ -57,6 +57,22 @@ void CmdParse::init() {
     reference_23comma = NULL;
     reference_29comma = NULL;
     reference_31comma = NULL;
+    window_size     = NULL;
+    hop_size        = NULL;
+    freq_range      = NULL;
+    fft_pad         = NULL;
+    jack_inputs     = NULL;
+    analysis_rate   = NULL;
+    estimator       = NULL;
+    analyze         = FALSE;
+    output_format   = NULL;
+    jobs            = NULL;
+    source          = NULL;
+    pacing          = NULL;
+    headless        = FALSE;
+    socket_path     = NULL;
+    midi_out        = FALSE;
+    bend_range      = NULL;
 }
 
 void CmdParse::write_optvar() {
@@ -160,7 +176,58 @@ if (reference_31comma != NULL) {
     } else if (!optvar[REFERENCE_31COMMA].empty()) {
         optvar[REFERENCE_31COMMA] = ""; 
     }
+    if (window_size != NULL) {
+        optvar[WINDOW_SIZE] = window_size;
+        g_free(window_size);
+    } else if (!optvar[WINDOW_SIZE].empty()) {
+        optvar[WINDOW_SIZE] = "";
+    }
+    if (hop_size != NULL) {
+        optvar[HOP_SIZE] = hop_size;
+        g_free(hop_size);
+    } else if (!optvar[HOP_SIZE].empty()) {
+        optvar[HOP_SIZE] = "";
+    }
+    if (freq_range != NULL) {
+        optvar[FREQ_RANGE] = freq_range;
+        g_free(freq_range);
+    } else if (!optvar[FREQ_RANGE].empty()) {
+        optvar[FREQ_RANGE] = "";
+    }
+    if (fft_pad != NULL) {
+        optvar[FFT_PAD] = fft_pad;
+        g_free(fft_pad);
+    } else if (!optvar[FFT_PAD].empty()) {
+        optvar[FFT_PAD] = "";
+    }
+    if (analysis_rate != NULL) {
+        optvar[ANALYSIS_RATE] = analysis_rate;
+        g_free(analysis_rate);
+    } else if (!optvar[ANALYSIS_RATE].empty()) {
+        optvar[ANALYSIS_RATE] = "";
+    }
+    if (estimator != NULL) {
+        optvar[ESTIMATOR] = estimator;
+        g_free(estimator);
+    } else if (!optvar[ESTIMATOR].empty()) {
+        optvar[ESTIMATOR] = "";
+    }
     
+    // *** process ANALYZE options
+    optvar[ANALYZE] = analyze ? "1" : "";
+    if (output_format != NULL) {
+        optvar[OUTPUT_FORMAT] = output_format;
+        g_free(output_format);
+    } else if (!optvar[OUTPUT_FORMAT].empty()) {
+        optvar[OUTPUT_FORMAT] = "";
+    }
+    if (jobs != NULL) {
+        optvar[JOBS] = jobs;
+        g_free(jobs);
+    } else if (!optvar[JOBS].empty()) {
+        optvar[JOBS] = "";
+    }
+
     // *** process GTK options
     if (size_y != NULL) {
         optvar[SIZE_Y] = size_y;
@@ -196,6 +263,14 @@ if (reference_31comma != NULL) {
     } else if (!optvar[DESK].empty()) {
         optvar[DESK] = ""; 
     }
+
+    optvar[HEADLESS] = headless ? "1" : "";
+    if (socket_path != NULL) {
+        optvar[SOCKET] = socket_path;
+        g_free(socket_path);
+    } else if (!optvar[SOCKET].empty()) {
+        optvar[SOCKET] = "";
+    }
     
     // *** process JACK options
     if (jack_input != NULL) {
@@ -204,6 +279,31 @@ if (reference_31comma != NULL) {
     } else if (!optvar[JACK_INP].empty()) {
         optvar[JACK_INP] = ""; // leads to no automatic connection
     }
+    if (jack_inputs != NULL) {
+        optvar[JACK_INPUTS] = jack_inputs;
+        g_free(jack_inputs);
+    } else if (!optvar[JACK_INPUTS].empty()) {
+        optvar[JACK_INPUTS] = "";
+    }
+    if (source != NULL) {
+        optvar[SOURCE] = source;
+        g_free(source);
+    } else if (!optvar[SOURCE].empty()) {
+        optvar[SOURCE] = "";
+    }
+    if (pacing != NULL) {
+        optvar[PACING] = pacing;
+        g_free(pacing);
+    } else if (!optvar[PACING].empty()) {
+        optvar[PACING] = "";
+    }
+    optvar[MIDI_OUT] = midi_out ? "1" : "";
+    if (bend_range != NULL) {
+        optvar[BEND_RANGE] = bend_range;
+        g_free(bend_range);
+    } else if (!optvar[BEND_RANGE].empty()) {
+        optvar[BEND_RANGE] = "";
+    }
 }
 
 void CmdParse::parse(int& argc, char**& argv) {
@@ -232,6 +332,10 @@ void CmdParse::setup_groups() {
             "'default' height ( -l 100 -> . .)", "HEIGHT" },
         { "desktop", 'd', 0, G_OPTION_ARG_STRING, &desktop,
             "set to virtual desktop num ( -d 0 -> . .)", "NUM" },
+        { "headless", 0, 0, G_OPTION_ARG_NONE, &headless,
+            "no window, write the estimates as json lines to stdout or --socket", NULL },
+        { "socket", 0, 0, G_OPTION_ARG_STRING, &socket_path,
+            "with --headless write to the clients of a unix socket (--socket /tmp/gxtuner)", "PATH" },
         { NULL }
     };
     g_option_group_add_entries(optgroup_gtk, opt_entries_gtk);
@@ -243,7 +347,17 @@ void CmdParse::setup_groups() {
     GOptionEntry opt_entries_jack[] =
     {
         { "jack-input", 'i', 0, G_OPTION_ARG_STRING, &jack_input,
-            "connect to JACK port name (-i system:capture_1)", "PORT" },
+            "connect to JACK port name, a comma separated list with --inputs (-i system:capture_1)", "PORT" },
+        { "inputs", 0, 0, G_OPTION_ARG_STRING, &jack_inputs,
+            "number of JACK input ports, each with its own tracker (--inputs 3)", "NUM" },
+        { "source", 0, 0, G_OPTION_ARG_STRING, &source,
+            "take the input from jack, a wav/flac file, raw samples on stdin or the signal generator (--source jack / file:NAME / stdin:RATE:s16 / gen:saw:110 )", "SOURCE" },
+        { "pacing", 0, 0, G_OPTION_ARG_STRING, &pacing,
+            "play a file or the signal generator in realtime or as fast as possible (--pacing realtime / fast )", "PACING" },
+        { "midi-out", 0, 0, G_OPTION_ARG_NONE, &midi_out,
+            "register a JACK midi port with note on/off and pitch bend of the estimates", NULL },
+        { "bend-range", 0, 0, G_OPTION_ARG_STRING, &bend_range,
+            "semitones of a full pitch bend for --midi-out (--bend-range 2)", "SEMITONES" },
         { NULL }
     };
     g_option_group_add_entries(optgroup_jack, opt_entries_jack);
@@ -292,12 +406,41 @@ void CmdParse::setup_groups() {
             "set reference 29 limit comma (-I min3 / min2 / min1 / 0 / 1 / 2 / 3 )", "REFERENCE_29COMMA" },
         { "reference_31comma", 'J', 0, G_OPTION_ARG_STRING, &reference_31comma,
             "set reference 31 limit comma (-J min3 / min2 / min1 / 0 / 1 / 2 / 3 )", "REFERENCE_31COMMA" },        
+        { "window-size", 0, 0, G_OPTION_ARG_STRING, &window_size,
+            "set analysis window in samples (--window-size 256 <-> 4096)", "SAMPLES" },
+        { "hop-size", 0, 0, G_OPTION_ARG_STRING, &hop_size,
+            "set samples between two estimates (--hop-size 128)", "SAMPLES" },
+        { "range", 0, 0, G_OPTION_ARG_STRING, &freq_range,
+            "limit detection to a frequency range in Hz (--range 30:400)", "FMIN:FMAX" },
+        { "fft-pad", 0, 0, G_OPTION_ARG_STRING, &fft_pad,
+            "set fft padding (--fft-pad min / smooth / pow2 )", "PADDING" },
+        { "analysis-rate", 0, 0, G_OPTION_ARG_STRING, &analysis_rate,
+            "analyse at 20500 Hz or at an integer fraction of the jack rate (--analysis-rate fixed / native )", "RATE" },
+        { "estimator", 0, 0, G_OPTION_ARG_STRING, &estimator,
+            "set pitch estimator (--estimator nsdf / yin / hps / cepstrum )", "ESTIMATOR" },
         { NULL }
     };
     g_option_group_add_entries(optgroup_engine, opt_entries_engine);
+
+    optgroup_analyze = g_option_group_new("analyze",
+          "\033[1;32mANALYZE configuration options\033[0m",
+          "\033[1;32mANALYZE configuration options\033[0m",
+          NULL, NULL);
+    GOptionEntry opt_entries_analyze[] =
+    {
+        { "analyze", 0, 0, G_OPTION_ARG_NONE, &analyze,
+            "analyse the wav (or flac) files given on the command line, without jack and window (--analyze a.wav b.flac)", NULL },
+        { "output-format", 0, 0, G_OPTION_ARG_STRING, &output_format,
+            "set format of the pitch tracks (--output-format csv / binary )", "FORMAT" },
+        { "jobs", 0, 0, G_OPTION_ARG_STRING, &jobs,
+            "number of files analysed at once, default one per cpu core (--jobs 2)", "NUM" },
+        { NULL }
+    };
+    g_option_group_add_entries(optgroup_analyze, opt_entries_analyze);
     g_option_context_add_group(opt_context, optgroup_gtk);
     g_option_context_add_group(opt_context, optgroup_jack);
     g_option_context_add_group(opt_context, optgroup_engine);
+    g_option_context_add_group(opt_context, optgroup_analyze);
     g_option_context_set_ignore_unknown_options(opt_context, true);
 }
 
@@ -53,6 +53,22 @@
 #define REFERENCE_23COMMA   (19)
 #define REFERENCE_29COMMA   (20)
 #define REFERENCE_31COMMA   (21)
+#define WINDOW_SIZE         (22)
+#define HOP_SIZE            (23)
+#define FREQ_RANGE          (24)
+#define FFT_PAD             (25)
+#define JACK_INPUTS         (26)
+#define ANALYSIS_RATE       (27)
+#define ESTIMATOR           (28)
+#define ANALYZE             (29)
+#define OUTPUT_FORMAT       (30)
+#define JOBS                (31)
+#define SOURCE              (32)
+#define PACING              (33)
+#define HEADLESS            (34)
+#define SOCKET              (35)
+#define MIDI_OUT            (36)
+#define BEND_RANGE          (37)
 
 class CmdParse {
  private:
@@ -61,6 +77,7 @@ class CmdParse {
     GOptionGroup*       optgroup_gtk;
     GOptionGroup*       optgroup_jack;
     GOptionGroup*       optgroup_engine;
+    GOptionGroup*       optgroup_analyze;
     gchar*              jack_uuid;
     gchar*              jack_input;
     gchar*              size_x;
@@ -83,13 +100,29 @@ class CmdParse {
     gchar*              reference_23comma;
     gchar*              reference_29comma;
     gchar*              reference_31comma;
+    gchar*              window_size;
+    gchar*              hop_size;
+    gchar*              freq_range;
+    gchar*              fft_pad;
+    gchar*              jack_inputs;
+    gchar*              analysis_rate;
+    gchar*              estimator;
+    gboolean            analyze;
+    gchar*              output_format;
+    gchar*              jobs;
+    gchar*              source;
+    gchar*              pacing;
+    gboolean            headless;
+    gchar*              socket_path;
+    gboolean            midi_out;
+    gchar*              bend_range;
     std::string         infostring;
     void                init();
     void                setup_groups();
     void                parse(int& argc, char**& argv);
     void                write_optvar();
  protected:
-    std::string         optvar[22]; //#3
+    std::string         optvar[38]; //#3
 
  public:
     explicit CmdParse();
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_analyze.cpp      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "./gx_analyze.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <map>
+
+#include "./gx_wavfile.h"
+
+// stdio buffer of an output file
+static const int OUTPUT_BUFFER = 1 << 16;
+
+BatchAnalyzer::BatchAnalyzer()
+    : m_setup(0),
+      m_format(FORMAT_CSV),
+      m_reference(440.0),
+      m_jobs(0),
+      m_files(0),
+      m_next(0),
+      m_failed(false) {
+}
+
+BatchAnalyzer::~BatchAnalyzer() {
+}
+
+std::string BatchAnalyzer::output_name(const std::string& file) {
+    size_t dot = file.rfind('.');
+    size_t slash = file.rfind('/');
+    std::string base = file;
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        base = file.substr(0, dot);
+    }
+    return base + (m_format == FORMAT_BINARY ? ".pitch" : ".csv");
+}
+
+bool BatchAnalyzer::run(const std::vector<std::string>& files) {
+    // take.wav and take.flac would write the same take.csv at once
+    std::map<std::string, std::string> outputs;
+    bool clash = false;
+    for (unsigned int i = 0; i < files.size(); i++) {
+        std::string out = output_name(files[i]);
+        std::map<std::string, std::string>::iterator j = outputs.find(out);
+        if (j != outputs.end()) {
+            fprintf(stderr, "%s and %s both go to %s\n", j->second.c_str(),
+                    files[i].c_str(), out.c_str());
+            clash = true;
+            continue;
+        }
+        outputs[out] = files[i];
+    }
+    if (clash) {
+        return false;
+    }
+    m_files = &files;
+    m_next.store(0);
+    m_failed.store(false);
+    int n = m_jobs;
+    if (n <= 0) {
+        n = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    if (n > static_cast<int>(files.size())) {
+        n = files.size();
+    }
+    // the calling thread takes a share of the files as well
+    std::vector<pthread_t> threads;
+    for (int i = 1; i < n; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, static_run, this) == 0) {
+            threads.push_back(t);
+        }
+    }
+    run_jobs();
+    for (unsigned int i = 0; i < threads.size(); i++) {
+        pthread_join(threads[i], NULL);
+    }
+    m_files = 0;
+    return !m_failed.load();
+}
+
+void *BatchAnalyzer::static_run(void *p) {
+    (reinterpret_cast<BatchAnalyzer *>(p))->run_jobs();
+    return NULL;
+}
+
+void BatchAnalyzer::run_jobs() {
+    float *buffer = new float[BLOCK_SIZE];
+    for (;;) {
+        unsigned int i = m_next.fetch_add(1);
+        if (i >= m_files->size()) {
+            break;
+        }
+        if (!analyse_file((*m_files)[i], buffer)) {
+            m_failed.store(true);
+        }
+    }
+    delete[] buffer;
+}
+
+// feed the file to the tracker block by block and run the analysis
+// whenever a hop is complete, nothing waits for the clock
+bool BatchAnalyzer::analyse_file(const std::string& name, float *buffer) {
+    WavFile wav;
+    if (!wav.open(name.c_str())) {
+        fprintf(stderr, "%s: %s\n", name.c_str(), wav.error().c_str());
+        return false;
+    }
+    std::string out = output_name(name);
+    FILE *f = fopen(out.c_str(), m_format == FORMAT_BINARY ? "wb" : "w");
+    if (!f) {
+        fprintf(stderr, "%s: can't write %s\n", name.c_str(), out.c_str());
+        return false;
+    }
+    setvbuf(f, NULL, _IOFBF, OUTPUT_BUFFER);
+    if (m_format == FORMAT_CSV) {
+        fprintf(f, "time,freq,clarity,note,cents\n");
+    }
+    PitchTracker *tracker = new PitchTracker;
+    if (m_setup) {
+        m_setup(tracker);
+    }
+    tracker->set_threaded(false);
+    tracker->set_onset_detection(false);
+    tracker->set_idle_mode(false);
+    tracker->set_max_period(BLOCK_SIZE);
+    tracker->init(wav.samplerate(), pthread_self());
+    const double rate = wav.samplerate();
+    unsigned int frame = 0;
+    int count;
+    while ((count = wav.read(BLOCK_SIZE, buffer)) > 0) {
+        tracker->add(count, buffer, frame);
+        frame += count;
+        while (tracker->analyse()) {
+            PitchResult r;
+            tracker->get_result(&r);
+            // the first windows end before the start of the file
+            float time = static_cast<int>(r.frame_time) / rate;
+            float note = 0.0;
+            float cents = 0.0;
+            if (r.freq > 0) {
+                float n = 12 * log2(r.freq / m_reference) + 69;
+                note = roundf(n);
+                cents = 100 * (n - note);
+            }
+            if (m_format == FORMAT_BINARY) {
+                float row[5] = { time, r.freq, r.clarity, note, cents };
+                fwrite(row, sizeof(row), 1, f);
+            } else {
+                fprintf(f, "%.4f,%.3f,%.3f,%d,%.1f\n", time, r.freq, r.clarity,
+                        static_cast<int>(note), cents);
+            }
+        }
+    }
+    delete tracker;
+    bool ok = !ferror(f);
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, "%s: error writing %s\n", name.c_str(), out.c_str());
+        return false;
+    }
+    return true;
+}
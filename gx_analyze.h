@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_analyze.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_ANALYZE_H_
+#define GX_ANALYZE_H_
+
+#include <pthread.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "./gx_pitch_tracker.h"
+
+/* ------------- offline analysis of wav/flac files ------------- */
+
+// Runs the pitch tracker over wav files (flac and the other formats of
+// libsndfile too, see WavFile) as fast as the cpu allows, one
+// tracker per file without an analysis thread of its own and with the
+// level gate and the onset detection switched off, so there is an
+// estimate for every hop. The files are shared out to one thread per
+// core, each writes a track next to its input: name.csv with the
+// columns time,freq,clarity,note,cents, or name.pitch with the same
+// five values as float32 in native byte order per hop. note is the
+// midi note number the frequency is closest to, cents the deviation
+// from it.
+
+class BatchAnalyzer {
+ public:
+    enum { FORMAT_CSV, FORMAT_BINARY };
+    explicit BatchAnalyzer();
+    ~BatchAnalyzer();
+    // called for every tracker before init(), to apply the options
+    void            set_setup(void (*setup)(PitchTracker *tracker)) { m_setup = setup; }
+    void            set_format(int v) { m_format = v; }
+    // A4 in Hz for the note and the cents
+    void            set_reference_pitch(double v) { m_reference = v; }
+    // number of threads, 0 == one per core
+    void            set_jobs(int v) { m_jobs = v; }
+    // analyse all files, false when one of them failed, or without
+    // analysing any when two of them have the same output_name()
+    bool            run(const std::vector<std::string>& files);
+    // name of the track for a file, the extension replaced
+    std::string     output_name(const std::string& file);
+ private:
+    // frames handed to PitchTracker::add() at once
+    enum { BLOCK_SIZE = 1024 };
+    void            (*m_setup)(PitchTracker *tracker);
+    int             m_format;
+    double          m_reference;
+    int             m_jobs;
+    const std::vector<std::string> *m_files;
+    // next file to take, and whether one failed
+    std::atomic<unsigned int> m_next;
+    std::atomic<bool> m_failed;
+    static void     *static_run(void *p);
+    void            run_jobs();
+    bool            analyse_file(const std::string& name, float *buffer);
+};
+
+#endif  // GX_ANALYZE_H_
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_audio_source.cpp      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "./gx_audio_source.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+
+// defaults of the stdin and gen sources
+static const int STDIN_RATE = 48000;
+static const double GEN_FREQ = 110.0;
+// a realtime source which is further behind than this (seconds) gives
+// up catching up and restarts the clock
+static const double MAX_LATE = 1.0;
+// poll period of the end of the input for the analysis to catch up (s)
+static const double DRAIN_POLL = 0.001;
+
+AudioSource *AudioSource::create(const std::string& spec, bool fast) {
+    std::vector<std::string> args;
+    size_t start = 0;
+    for (;;) {
+        size_t end = spec.find(':', start);
+        args.push_back(spec.substr(start, end - start));
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    if (args[0] == "file" && spec.size() > 5) {
+        // the name may contain colons
+        return new FileSource(spec.substr(5), fast);
+    }
+    if (args[0] == "stdin") {
+        int rate = args.size() > 1 ? atoi(args[1].c_str()) : STDIN_RATE;
+        int format = StdinSource::FORMAT_S16;
+        if (args.size() > 2 && args[2] == "f32") {
+            format = StdinSource::FORMAT_F32;
+        } else if (args.size() > 2 && args[2] != "s16") {
+            return 0;
+        }
+        return rate > 0 ? new StdinSource(rate, format) : 0;
+    }
+    if (args[0] == "gen") {
+        int kind = args.size() > 1 ? SignalGen::find(args[1]) : SignalGen::SAW;
+        double freq = args.size() > 2 ? atof(args[2].c_str()) : GEN_FREQ;
+        return (kind >= 0 && freq > 0) ? new GenSource(kind, freq, fast) : 0;
+    }
+    return 0;
+}
+
+/****************************************************************
+ ** ThreadedSource
+ */
+
+ThreadedSource::ThreadedSource(bool fast)
+    : AudioSource(),
+      m_fast(fast),
+      m_samplerate(0),
+      m_period(DEFAULT_PERIOD),
+      m_buffers(),
+      m_pthr(0),
+      m_owner(pthread_self()),
+      m_running(false),
+      m_lastFrame(0),
+      m_frame(0) {
+}
+
+ThreadedSource::~ThreadedSource() {
+    stop();
+    for (unsigned int i = 0; i < m_buffers.size(); i++) {
+        delete[] m_buffers[i];
+    }
+}
+
+void ThreadedSource::setup(int inputs, int samplerate) {
+    m_samplerate = samplerate;
+    m_owner = pthread_self();
+    for (int i = 0; i < inputs; i++) {
+        float *p = new float[m_period];
+        memset(p, 0, m_period * sizeof(*p));
+        m_buffers.push_back(p);
+    }
+}
+
+bool ThreadedSource::start() {
+    if (m_pthr || m_buffers.empty()) {
+        return false;
+    }
+    m_running.store(true);
+    if (pthread_create(&m_pthr, NULL, static_run, this) != 0) {
+        m_pthr = 0;
+        m_running.store(false);
+        return false;
+    }
+    return true;
+}
+
+// the thread ends after the current period, it is only cancelled
+// while it waits for stdin
+void ThreadedSource::stop() {
+    if (!m_pthr) {
+        return;
+    }
+    m_running.store(false);
+    if (!pthread_equal(m_pthr, pthread_self())) {
+        pthread_cancel(m_pthr);
+        pthread_join(m_pthr, NULL);
+    }
+    m_pthr = 0;
+}
+
+void *ThreadedSource::static_run(void *p) {
+    (reinterpret_cast<ThreadedSource *>(p))->run();
+    return NULL;
+}
+
+void ThreadedSource::run() {
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    unsigned int frame = 0;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    while (m_running.load(std::memory_order_relaxed)) {
+        int n = fill();
+        if (n <= 0) {
+            // the last hops may still wait for the analysis
+            while (m_drained && !m_drained() && m_running.load(std::memory_order_relaxed)) {
+                struct timespec ts;
+                ts.tv_sec = 0;
+                ts.tv_nsec = static_cast<long>(DRAIN_POLL * 1e9);
+                nanosleep(&ts, NULL);
+            }
+            if (m_finished) {
+                m_finished();
+            }
+            return;
+        }
+        m_lastFrame = frame;
+        for (unsigned int i = 0; i < m_buffers.size(); i++) {
+            m_process(i, n, m_buffers[i]);
+        }
+        frame += n;
+        m_frame.store(frame, std::memory_order_relaxed);
+        if (m_fast) {
+            continue;
+        }
+        // wait until the period would have been played
+        long ns = next.tv_nsec + static_cast<long>(1e9 * n / m_samplerate);
+        next.tv_sec += ns / 1000000000;
+        next.tv_nsec = ns % 1000000000;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec - next.tv_sec > MAX_LATE) {
+            next = now;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+    }
+}
+
+/****************************************************************
+ ** FileSource
+ */
+
+FileSource::FileSource(const std::string& name, bool fast)
+    : ThreadedSource(fast),
+      m_name(name),
+      m_file() {
+}
+
+bool FileSource::open(int inputs) {
+    if (!m_file.open(m_name.c_str())) {
+        fprintf(stderr, "%s: %s\n", m_name.c_str(), m_file.error().c_str());
+        return false;
+    }
+    setup(inputs, m_file.samplerate());
+    return true;
+}
+
+int FileSource::fill() {
+    int n = m_file.read(m_period, m_buffers[0]);
+    for (unsigned int i = 1; i < m_buffers.size(); i++) {
+        memcpy(m_buffers[i], m_buffers[0], n * sizeof(float));
+    }
+    return n;
+}
+
+/****************************************************************
+ ** StdinSource
+ */
+
+// the writer sets the pace, read() blocks until it has written
+StdinSource::StdinSource(int samplerate, int format)
+    : ThreadedSource(true),
+      m_rate(samplerate),
+      m_format(format),
+      m_raw(0),
+      m_frameSize(0) {
+}
+
+StdinSource::~StdinSource() {
+    stop();
+    delete[] m_raw;
+}
+
+bool StdinSource::open(int inputs) {
+    setup(inputs, m_rate);
+    m_frameSize = inputs * (m_format == FORMAT_F32 ? sizeof(float) : sizeof(int16_t));
+    m_raw = new char[m_period * m_frameSize];
+    return true;
+}
+
+// a pipe delivers whatever it has, read until the period is complete
+int StdinSource::fill() {
+    int size = m_period * m_frameSize;
+    int have = 0;
+    while (have < size) {
+        int state;
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &state);
+        ssize_t n = read(0, m_raw + have, size - have);
+        pthread_setcancelstate(state, NULL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        have += n;
+    }
+    int frames = have / m_frameSize;
+    int inputs = m_buffers.size();
+    for (int i = 0; i < inputs; i++) {
+        float *out = m_buffers[i];
+        if (m_format == FORMAT_F32) {
+            const float *in = reinterpret_cast<const float*>(m_raw) + i;
+            for (int j = 0; j < frames; j++) {
+                out[j] = in[j * inputs];
+            }
+        } else {
+            const int16_t *in = reinterpret_cast<const int16_t*>(m_raw) + i;
+            for (int j = 0; j < frames; j++) {
+                out[j] = in[j * inputs] * (1.0f / 32768);
+            }
+        }
+    }
+    return frames;
+}
+
+/****************************************************************
+ ** GenSource
+ */
+
+GenSource::GenSource(int kind, double freq, bool fast)
+    : ThreadedSource(fast),
+      m_kind(kind),
+      m_freq(freq),
+      m_gen() {
+}
+
+bool GenSource::open(int inputs) {
+    setup(inputs, SAMPLERATE);
+    m_gen.setup(m_kind, m_freq, SAMPLERATE);
+    return true;
+}
+
+int GenSource::fill() {
+    m_gen.generate(m_period, m_buffers[0]);
+    for (unsigned int i = 1; i < m_buffers.size(); i++) {
+        memcpy(m_buffers[i], m_buffers[0], m_period * sizeof(float));
+    }
+    return m_period;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_audio_source.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_AUDIO_SOURCE_H_
+#define GX_AUDIO_SOURCE_H_
+
+#include <pthread.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "./gx_signalgen.h"
+#include "./gx_wavfile.h"
+
+/* ------------- where the samples come from ------------- */
+
+// An AudioSource hands periods of samples of each of its inputs to the
+// process callback, from a thread of its own. JackTuner is the one for
+// jack, the others read a wav file, raw samples from stdin or run the
+// signal generator, so the tuner also works on a box without jack.
+
+typedef void (*audioprocess)
+             (int port, int count, float *input);
+typedef void (*audiofinished)
+             ();
+typedef bool (*audiodrained)
+             ();
+
+class AudioSource {
+ public:
+    virtual         ~AudioSource() {}
+    // connect to the device with the given number of inputs, false
+    // (with a message on stderr) when that fails. samplerate() and
+    // period() are valid afterwards.
+    virtual bool    open(int inputs) = 0;
+    // start delivering periods to the process callback
+    virtual bool    start() = 0;
+    virtual void    stop() = 0;
+    virtual int     samplerate() = 0;
+    // frames per call of the process callback
+    virtual int     period() = 0;
+    // frame time of the first sample of the period in the process
+    // callback, only valid there
+    virtual unsigned int last_frame_time() = 0;
+    // frame time now, in the clock of last_frame_time()
+    virtual unsigned int frame_time() = 0;
+    // thread the priority of the analysis threads is taken from
+    virtual pthread_t thread() = 0;
+    // true when the source runs as fast as the process callback takes
+    // the periods, the callback should then analyse them right away
+    // instead of leaving them to an analysis thread
+    virtual bool    fast() { return false; }
+    // process: called for every period of every input, finished: called
+    // once from the thread of the source when the input has ended,
+    // drained: polled before finished until the consumers have done
+    // what they were given (0 == don't wait)
+    void            set_callbacks(audioprocess process, audiofinished finished,
+                                  audiodrained drained = 0) {
+        m_process = process;
+        m_finished = finished;
+        m_drained = drained;
+    }
+    // a source for a --source argument other than "jack", 0 for an
+    // unknown one: file:NAME, stdin[:RATE[:s16|f32]] or
+    // gen[:KIND[:FREQ]]. fast == as fast as the cpu allows instead of
+    // in realtime, stdin always takes the samples as they come.
+    static AudioSource *create(const std::string& spec, bool fast);
+ protected:
+    AudioSource() : m_process(0), m_finished(0), m_drained(0) {}
+    audioprocess    m_process;
+    audiofinished   m_finished;
+    audiodrained    m_drained;
+};
+
+// common part of the sources which run a thread of their own: it
+// calls fill() for each period and waits for the next one unless the
+// source runs fast. The destructors of the subclasses stop() the
+// thread, before fill() goes away.
+class ThreadedSource : public AudioSource {
+ public:
+    virtual         ~ThreadedSource();
+    virtual bool    start();
+    virtual void    stop();
+    virtual int     samplerate() { return m_samplerate; }
+    virtual int     period() { return m_period; }
+    virtual unsigned int last_frame_time() { return m_lastFrame; }
+    virtual unsigned int frame_time() { return m_frame.load(std::memory_order_relaxed); }
+    virtual pthread_t thread() { return m_owner; }
+    virtual bool    fast() { return m_fast; }
+ protected:
+    enum { DEFAULT_PERIOD = 256 };
+    explicit ThreadedSource(bool fast);
+    // set up the buffers, by open() of the subclasses
+    void            setup(int inputs, int samplerate);
+    // the next period of all inputs in m_buffers, the number of frames,
+    // 0 at the end of the input
+    virtual int     fill() = 0;
+    bool            m_fast;
+    int             m_samplerate;
+    int             m_period;
+    // one buffer of m_period frames per input
+    std::vector<float*> m_buffers;
+ private:
+    pthread_t       m_pthr;
+    // the thread which opened the source
+    pthread_t       m_owner;
+    std::atomic<bool> m_running;
+    unsigned int    m_lastFrame;
+    std::atomic<unsigned int> m_frame;
+    static void     *static_run(void *p);
+    void            run();
+};
+
+// a wav file, mixed down to mono for every input
+class FileSource : public ThreadedSource {
+ public:
+    FileSource(const std::string& name, bool fast);
+    virtual         ~FileSource() { stop(); }
+    virtual bool    open(int inputs);
+ private:
+    std::string     m_name;
+    WavFile         m_file;
+    virtual int     fill();
+};
+
+// raw interleaved samples on stdin, one channel per input
+class StdinSource : public ThreadedSource {
+ public:
+    enum { FORMAT_S16, FORMAT_F32 };
+    StdinSource(int samplerate, int format);
+    virtual         ~StdinSource();
+    virtual bool    open(int inputs);
+ private:
+    int             m_rate;
+    int             m_format;
+    // one period as read
+    char           *m_raw;
+    int             m_frameSize;
+    virtual int     fill();
+};
+
+// the signal generator on every input
+class GenSource : public ThreadedSource {
+ public:
+    enum { SAMPLERATE = 48000 };
+    GenSource(int kind, double freq, bool fast);
+    virtual         ~GenSource() { stop(); }
+    virtual bool    open(int inputs);
+ private:
+    int             m_kind;
+    double          m_freq;
+    SignalGen       m_gen;
+    virtual int     fill();
+};
+
+#endif  // GX_AUDIO_SOURCE_H_
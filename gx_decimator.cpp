@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_decimator.cpp      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "./gx_decimator.h"
+
+#include <cmath>
+#include <cstring>
+
+// The tracker input is already low passed at 1 kHz (4th order), so the
+// stages only need to keep the band above fs_out/2 from folding back
+// onto the harmonics: short filters for the first stages, a longer one
+// for the last.
+static const int FIRST_STAGE_TAPS = 11;
+static const int LAST_STAGE_TAPS = 19;
+// highest analysis rate, relative to fs_target, taken without resampling
+static const double MAX_RATE_RATIO = 1.25;
+
+void HalfBand::setup(int taps) {
+    ntaps = taps;
+    int half = (ntaps - 1) / 2;
+    int n = (ntaps + 1) / 4;
+    // blackman windowed sinc, cut off at fs/4
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        int k = 2 * i + 1;
+        double h = sin(M_PI * k / 2) / (M_PI * k);
+        double w = 0.42 + 0.5 * cos(M_PI * k / (half + 1))
+                        + 0.08 * cos(2 * M_PI * k / (half + 1));
+        coef[i] = h * w;
+        sum += 2 * coef[i];
+    }
+    // unity gain at dc, the centre tap is 0.5
+    for (int i = 0; i < n; i++) {
+        coef[i] *= 0.5 / sum;
+    }
+    reset();
+}
+
+void HalfBand::reset() {
+    memset(work, 0, sizeof(work));
+    phase = 0;
+}
+
+int HalfBand::process(int count, const float *input, float *output) {
+    const int hist = ntaps - 1;
+    const int half = hist / 2;
+    const int n = (ntaps + 1) / 4;
+    int out = 0;
+    while (count > 0) {
+        int len = count < BLOCK ? count : BLOCK;
+        memcpy(work + hist, input, len * sizeof(*work));
+        // an output for every second input sample, w[0] is the oldest
+        // and w[ntaps-1] the newest sample under the filter
+        for (int j = 1 - phase; j < len; j += 2) {
+            const float *w = &work[j];
+            float y = 0.5f * w[half];
+            for (int i = 0; i < n; i++) {
+                int k = 2 * i + 1;
+                y += coef[i] * (w[half - k] + w[half + k]);
+            }
+            output[out++] = y;
+        }
+        memmove(work, work + len, hist * sizeof(*work));
+        phase = (phase + len) & 1;
+        input += len;
+        count -= len;
+    }
+    return out;
+}
+
+int FirDecimator::setup(int d) {
+    factor = d < 1 ? 1 : d > MAX_FACTOR ? MAX_FACTOR : d;
+    ntaps = TAPS_PER_FACTOR * factor + 1;
+    int half = (ntaps - 1) / 2;
+    // cut off a bit below the new nyquist frequency
+    double fc = 0.4 / factor;
+    double sum = 0.0;
+    for (int i = 0; i < ntaps; i++) {
+        int k = i - half;
+        double h = k ? sin(2 * M_PI * fc * k) / (M_PI * k) : 2 * fc;
+        double w = 0.42 + 0.5 * cos(M_PI * k / (half + 1))
+                        + 0.08 * cos(2 * M_PI * k / (half + 1));
+        coef[i] = h * w;
+        sum += coef[i];
+    }
+    for (int i = 0; i < ntaps; i++) {
+        coef[i] /= sum;
+    }
+    reset();
+    return factor;
+}
+
+void FirDecimator::reset() {
+    memset(work, 0, sizeof(work));
+    phase = 0;
+}
+
+int FirDecimator::process(int count, const float *input, float *output) {
+    const int hist = ntaps - 1;
+    int out = 0;
+    while (count > 0) {
+        int len = count < BLOCK ? count : BLOCK;
+        memcpy(work + hist, input, len * sizeof(*work));
+        for (int j = factor - 1 - phase; j < len; j += factor) {
+            const float *w = &work[j];
+            float y = 0.0f;
+            for (int i = 0; i < ntaps; i++) {
+                y += coef[i] * w[i];
+            }
+            output[out++] = y;
+        }
+        memmove(work, work + len, hist * sizeof(*work));
+        phase = (phase + len) % factor;
+        input += len;
+        count -= len;
+    }
+    return out;
+}
+
+int Decimator::setup(int fs_in, int fs_target) {
+    firFactor = 1;
+    int k = 0;
+    while (k < MAX_STAGES && fs_in % (2 << k) == 0 && (fs_in >> (k + 1)) >= fs_target) {
+        k++;
+    }
+    if ((fs_in >> k) < fs_target || (fs_in >> k) > MAX_RATE_RATIO * fs_target) {
+        nstages = 0;
+        return 0;
+    }
+    nstages = k;
+    for (int i = 0; i < nstages; i++) {
+        stages[i].setup(i == nstages - 1 ? LAST_STAGE_TAPS : FIRST_STAGE_TAPS);
+    }
+    return factor();
+}
+
+int Decimator::setup_native(int fs_in, int fs_target) {
+    if (setup(fs_in, fs_target)) {
+        return factor();
+    }
+    nstages = 0;
+    firFactor = fir.setup(fs_in / fs_target);
+    return factor();
+}
+
+void Decimator::reset() {
+    for (int i = 0; i < nstages; i++) {
+        stages[i].reset();
+    }
+    fir.reset();
+}
+
+int Decimator::delay() const {
+    int d = 0;
+    for (int i = 0; i < nstages; i++) {
+        d += stages[i].delay() << i;
+    }
+    if (firFactor > 1) {
+        d += fir.delay() << nstages;
+    }
+    return d;
+}
+
+int Decimator::process(int count, const float *input, float *output) {
+    if (!nstages && firFactor == 1) {
+        if (output != input) {
+            memmove(output, input, count * sizeof(*output));
+        }
+        return count;
+    }
+    if (nstages) {
+        count = stages[0].process(count, input, output);
+        input = output;
+    }
+    for (int i = 1; i < nstages; i++) {
+        count = stages[i].process(count, output, output);
+    }
+    if (firFactor > 1) {
+        count = fir.process(count, input, output);
+    }
+    return count;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_decimator.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_DECIMATOR_H_
+#define GX_DECIMATOR_H_
+
+/* ------------- cascaded half-band decimation ------------- */
+
+// Half-band FIR, decimating by 2. Every second tap besides the centre
+// tap is zero, so in polyphase form one phase is a plain delay and the
+// other a symmetric filter: (ntaps+1)/4 multiplies per output sample.
+
+class HalfBand {
+ private:
+    enum { MAX_TAPS = 31, BLOCK = 256 };
+    // ntaps is 4*k+3, so both outer taps are non zero
+    int             ntaps;
+    // taps at distance 1, 3, 5, .. from the centre
+    float           coef[(MAX_TAPS + 1) / 4];
+    // the last ntaps-1 input samples followed by the current block
+    float           work[MAX_TAPS - 1 + BLOCK];
+    // number of input samples seen, modulo 2
+    int             phase;
+ public:
+    void            setup(int taps);
+    void            reset();
+    // group delay in samples at the input rate
+    int             delay() const { return (ntaps - 1) / 2; }
+    // in place is fine, output i is written after input 2*i was read
+    int             process(int count, const float *input, float *output);
+};
+
+// Windowed sinc low pass, decimating by an integer factor. Only the
+// kept output samples are computed.
+
+class FirDecimator {
+ private:
+    enum { MAX_FACTOR = 16, TAPS_PER_FACTOR = 8, BLOCK = 256,
+           MAX_TAPS = TAPS_PER_FACTOR * MAX_FACTOR + 1 };
+    int             factor;
+    int             ntaps;
+    float           coef[MAX_TAPS];
+    // the last ntaps-1 input samples followed by the current block
+    float           work[MAX_TAPS - 1 + BLOCK];
+    // input samples since the last output sample
+    int             phase;
+ public:
+    // returns the factor in use, clamped to 1 .. MAX_FACTOR
+    int             setup(int d);
+    void            reset();
+    int             delay() const { return (ntaps - 1) / 2; }
+    int             process(int count, const float *input, float *output);
+};
+
+// Chain of half-band stages for input rates that are a power of two
+// times the analysis rate (44.1/48/88.2/96/176.4/192 kHz). Phase
+// linear, and much cheaper than a general resampler.
+
+class Decimator {
+ private:
+    enum { MAX_STAGES = 4 };
+    HalfBand        stages[MAX_STAGES];
+    int             nstages;
+    // integer decimation for the rates the half-band chain can't do
+    FirDecimator    fir;
+    int             firFactor;
+ public:
+    explicit Decimator() : nstages(0), firFactor(1) {}
+    // pick a chain bringing fs_in down to about fs_target, returns the
+    // decimation factor or 0 when fs_in needs a resampler
+    int             setup(int fs_in, int fs_target);
+    // like setup(), but never needs a resampler: falls back to the
+    // integer factor fs_in / fs_target, the analysis runs at the rate
+    // which comes out of it
+    int             setup_native(int fs_in, int fs_target);
+    void            reset();
+    int             factor() const { return (1 << nstages) * firFactor; }
+    // group delay in samples at the input rate
+    int             delay() const;
+    // returns the number of output samples, may work in place
+    int             process(int count, const float *input, float *output);
+};
+
+#endif  // GX_DECIMATOR_H_
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_headless.cpp      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "./gx_headless.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+
+static const char *note_names[12] = {
+    "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
+};
+// how often run() looks for new clients of the socket (seconds)
+static const double ACCEPT_PERIOD = 0.1;
+
+HeadlessOutput::HeadlessOutput()
+    : m_trackers(),
+      m_freq(),
+      m_reference(440.0),
+      m_quit(false),
+      m_path(),
+      m_listen(-1),
+      m_clients() {
+    sem_init(&m_wakeup, 0, 0);
+}
+
+HeadlessOutput::~HeadlessOutput() {
+    for (unsigned int i = 0; i < m_clients.size(); i++) {
+        close(m_clients[i].fd);
+    }
+    if (m_listen >= 0) {
+        close(m_listen);
+        unlink(m_path.c_str());
+    }
+    sem_destroy(&m_wakeup);
+}
+
+bool HeadlessOutput::open(const std::string& path) {
+    if (path.empty()) {
+        return true;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path %s too long\n", path.c_str());
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "socket: %s\n", strerror(errno));
+        return false;
+    }
+    // a socket left over from an earlier run
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(fd, 8) < 0) {
+        fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+    m_listen = fd;
+    m_path = path;
+    return true;
+}
+
+void HeadlessOutput::add(PitchTracker *tracker) {
+    m_trackers.push_back(tracker);
+    m_freq.push_back(-1);
+}
+
+void HeadlessOutput::quit() {
+    m_quit.store(true);
+    sem_post(&m_wakeup);
+}
+
+void HeadlessOutput::accept_clients() {
+    for (;;) {
+        int fd = accept4(m_listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        Client c;
+        c.fd = fd;
+        m_clients.push_back(c);
+    }
+}
+
+bool HeadlessOutput::flush_client(Client& c) {
+    while (!c.pending.empty()) {
+        ssize_t n = send(c.fd, c.pending.data(), c.pending.size(),
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        }
+        c.pending.erase(0, n);
+    }
+    return true;
+}
+
+void HeadlessOutput::flush_clients() {
+    for (unsigned int i = 0; i < m_clients.size(); ) {
+        if (!flush_client(m_clients[i])) {
+            close(m_clients[i].fd);
+            m_clients.erase(m_clients.begin() + i);
+            continue;
+        }
+        i++;
+    }
+}
+
+// a client which can't keep up loses whole lines: a line the socket
+// took in part is finished first, one it takes nothing of is dropped.
+// A client which has gone away is dropped.
+void HeadlessOutput::write_line(const char *line, int size) {
+    if (m_listen < 0) {
+        fwrite(line, 1, size, stdout);
+        fflush(stdout);
+        return;
+    }
+    for (unsigned int i = 0; i < m_clients.size(); ) {
+        Client& c = m_clients[i];
+        bool alive = flush_client(c);
+        if (alive && c.pending.empty()) {
+            ssize_t n = send(c.fd, line, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n >= 0 && n < size) {
+                c.pending.assign(line + n, size - n);
+            } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                alive = false;
+            }
+        }
+        if (!alive) {
+            close(c.fd);
+            m_clients.erase(m_clients.begin() + i);
+            continue;
+        }
+        i++;
+    }
+}
+
+int HeadlessOutput::format(char *line, int size, int input, const PitchResult& r) {
+    if (r.freq <= 0) {
+        return snprintf(line, size,
+                        "{\"input\":%d,\"freq\":0,\"confidence\":%.2f,\"frame\":%u}\n",
+                        input, r.clarity, r.frame_time);
+    }
+    double n = 12 * log2(r.freq / m_reference) + 69;
+    int midi = static_cast<int>(round(n));
+    double cents = 100 * (n - midi);
+    return snprintf(line, size,
+                    "{\"input\":%d,\"freq\":%.2f,\"note\":\"%s%d\",\"midi\":%d,"
+                    "\"cents\":%.1f,\"confidence\":%.2f,\"frame\":%u}\n",
+                    input, r.freq, note_names[((midi % 12) + 12) % 12], midi / 12 - 1,
+                    midi, cents, r.clarity, r.frame_time);
+}
+
+void HeadlessOutput::run() {
+    while (!m_quit.load()) {
+        if (m_listen >= 0) {
+            // wake up now and then to take new clients
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            long ns = ts.tv_nsec + static_cast<long>(ACCEPT_PERIOD * 1e9);
+            ts.tv_sec += ns / 1000000000;
+            ts.tv_nsec = ns % 1000000000;
+            sem_timedwait(&m_wakeup, &ts);
+            accept_clients();
+            flush_clients();
+        } else {
+            sem_wait(&m_wakeup);
+        }
+        // several changes since the last look come out as one line,
+        // a repeated estimate (silence) as none
+        for (unsigned int i = 0; i < m_trackers.size(); i++) {
+            PitchResult r;
+            m_trackers[i]->get_result(&r);
+            if (!r.seq || r.freq == m_freq[i]) {
+                continue;
+            }
+            m_freq[i] = r.freq;
+            char line[256];
+            int n = format(line, sizeof(line), i, r);
+            write_line(line, n);
+        }
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_headless.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_HEADLESS_H_
+#define GX_HEADLESS_H_
+
+#include <semaphore.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "./gx_pitch_tracker.h"
+
+/* ------------- estimates as json lines ------------- */
+
+// The tuner without a window: every new estimate of a tracker becomes a
+// line like
+//   {"input":0,"freq":110.02,"note":"A2","midi":45,"cents":0.3,
+//    "confidence":0.99,"frame":123456}
+// on stdout or for every client of a unix socket. A line without note,
+// midi and cents means no pitch. The trackers call notify() when their
+// estimate changes, run() writes the lines from the main thread, so a
+// slow reader never holds up the analysis.
+
+class HeadlessOutput {
+ public:
+    explicit HeadlessOutput();
+    ~HeadlessOutput();
+    // "" == stdout, else listen on a unix socket at path, false (with a
+    // message on stderr) when that fails
+    bool            open(const std::string& path);
+    // A4 in Hz for the note and the cents
+    void            set_reference_pitch(double v) { m_reference = v; }
+    void            add(PitchTracker *tracker);
+    // wake up run(), from any thread and from a signal handler
+    void            notify() { sem_post(&m_wakeup); }
+    // let run() return, the same
+    void            quit();
+    // write the estimates until quit()
+    void            run();
+ private:
+    std::vector<PitchTracker*> m_trackers;
+    // last frequency written per tracker
+    std::vector<float> m_freq;
+    double          m_reference;
+    sem_t           m_wakeup;
+    std::atomic<bool> m_quit;
+    // listening socket and its clients, -1 == stdout only
+    std::string     m_path;
+    int             m_listen;
+    struct Client {
+        int             fd;
+        // rest of a line the socket took only in part
+        std::string     pending;
+    };
+    std::vector<Client> m_clients;
+    void            accept_clients();
+    // send what is left of the last line, false when the client is gone
+    bool            flush_client(Client& c);
+    void            flush_clients();
+    void            write_line(const char *line, int size);
+    int             format(char *line, int size, int input, const PitchResult& r);
+};
+
+#endif  // GX_HEADLESS_H_
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_midi_out.cpp      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "./gx_midi_out.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const int NOTE_OFF = 0x80;
+static const int NOTE_ON = 0x90;
+static const int PITCH_BEND = 0xe0;
+static const int BEND_CENTER = 8192;
+static const int DEFAULT_BEND_RANGE = 2;
+// semitones past the half way mark before the note changes
+static const double NOTE_HYSTERESIS = 0.15;
+// rms level (dB) of velocity 1, 0 dB gives 127
+static const double VELOCITY_FLOOR = -60.0;
+
+MidiOut::MidiOut()
+    : m_nchannels(0),
+      m_reference(440.0),
+      m_bendRange(DEFAULT_BEND_RANGE),
+      m_latency(0),
+      m_stop(false),
+      m_stopped(false),
+      m_npending(0),
+      m_count(0) {
+}
+
+void MidiOut::add(PitchTracker *tracker) {
+    if (m_nchannels == MAX_CHANNELS) {
+        return;
+    }
+    Channel& c = m_channels[m_nchannels++];
+    c.tracker = tracker;
+    c.note = -1;
+    c.bend = BEND_CENTER;
+    c.seq = 0;
+}
+
+// keep the queue sorted by time, jack wants the events in order. The
+// times of a channel only grow, the channels may be apart. A full
+// queue drops the new note ons and bends, a note off takes the place
+// of the latest queued event which isn't one, so no note hangs.
+void MidiOut::push(unsigned int time, int status, int data1, int data2) {
+    if (m_npending == MAX_EVENTS) {
+        if ((status & 0xf0) != NOTE_OFF) {
+            return;
+        }
+        int j = m_npending - 1;
+        while (j >= 0 && (m_pending[j].data[0] & 0xf0) == NOTE_OFF) {
+            j--;
+        }
+        if (j < 0) {
+            return;
+        }
+        memmove(m_pending + j, m_pending + j + 1, (m_npending - j - 1) * sizeof(*m_pending));
+        m_npending--;
+    }
+    int i = m_npending++;
+    while (i > 0 && static_cast<int>(m_pending[i - 1].time - time) > 0) {
+        m_pending[i] = m_pending[i - 1];
+        i--;
+    }
+    Pending& e = m_pending[i];
+    e.time = time;
+    e.data[0] = status;
+    e.data[1] = data1;
+    e.data[2] = data2;
+}
+
+void MidiOut::update(int channel, const PitchResult& r, unsigned int time) {
+    Channel& c = m_channels[channel];
+    if (r.freq <= 0) {
+        if (c.note >= 0) {
+            push(time, NOTE_OFF | channel, c.note, 0);
+            c.note = -1;
+        }
+        return;
+    }
+    double n = 12 * log2(r.freq / m_reference.load(std::memory_order_relaxed)) + 69;
+    int note = c.note;
+    if (note < 0 || fabs(n - note) > 0.5 + NOTE_HYSTERESIS) {
+        note = static_cast<int>(round(n));
+    }
+    if (note < 0 || note > 127) {
+        return;
+    }
+    int bend = BEND_CENTER + static_cast<int>(round((n - note) / m_bendRange * BEND_CENTER));
+    bend = bend < 0 ? 0 : bend > 16383 ? 16383 : bend;
+    if (note != c.note && c.note >= 0) {
+        push(time, NOTE_OFF | channel, c.note, 0);
+    }
+    // the bend goes first, so the new note starts in tune
+    if (bend != c.bend) {
+        push(time, PITCH_BEND | channel, bend & 0x7f, bend >> 7);
+        c.bend = bend;
+    }
+    if (note != c.note) {
+        double db = 20 * log10(std::max(r.rms, 1e-10f));
+        int velocity = static_cast<int>(127 * (1.0 - db / VELOCITY_FLOOR));
+        velocity = velocity < 1 ? 1 : velocity > 127 ? 127 : velocity;
+        push(time, NOTE_ON | channel, note, velocity);
+        c.note = note;
+    }
+}
+
+// the last period: the queued note offs go out now, the queued note
+// ons and bends never, and every channel turns off its note. A note
+// on which never went out gets a harmless note off.
+void MidiOut::flush() {
+    m_count = 0;
+    for (int i = 0; i < m_npending; i++) {
+        if ((m_pending[i].data[0] & 0xf0) != NOTE_OFF) {
+            continue;
+        }
+        MidiEvent& e = m_events[m_count++];
+        e.offset = 0;
+        memcpy(e.data, m_pending[i].data, sizeof(e.data));
+        e.size = 3;
+    }
+    m_npending = 0;
+    for (int i = 0; i < m_nchannels; i++) {
+        if (m_channels[i].note < 0) {
+            continue;
+        }
+        MidiEvent& e = m_events[m_count++];
+        e.offset = 0;
+        e.data[0] = NOTE_OFF | i;
+        e.data[1] = m_channels[i].note;
+        e.data[2] = 0;
+        e.size = 3;
+        m_channels[i].note = -1;
+    }
+    m_stopped.store(true);
+}
+
+// an estimate is only known some time after the end of its window,
+// its events are queued for that frame time plus the latency
+void MidiOut::process(unsigned int start, int nframes) {
+    if (m_stopped.load(std::memory_order_relaxed)) {
+        m_count = 0;
+        return;
+    }
+    if (m_stop.load(std::memory_order_relaxed)) {
+        flush();
+        return;
+    }
+    unsigned int latency = m_latency.load(std::memory_order_relaxed);
+    for (int i = 0; i < m_nchannels; i++) {
+        PitchResult r;
+        // the analysis thread is publishing, look again next period
+        if (!m_channels[i].tracker->try_get_result(&r) ||
+            r.seq == m_channels[i].seq) {
+            continue;
+        }
+        m_channels[i].seq = r.seq;
+        update(i, r, r.frame_time + latency);
+    }
+    // the events due in this period, late ones at its start
+    m_count = 0;
+    while (m_count < m_npending) {
+        int offset = static_cast<int>(m_pending[m_count].time - start);
+        if (offset >= nframes) {
+            break;
+        }
+        MidiEvent& e = m_events[m_count];
+        e.offset = offset < 0 ? 0 : offset;
+        memcpy(e.data, m_pending[m_count].data, sizeof(e.data));
+        e.size = 3;
+        m_count++;
+    }
+    m_npending -= m_count;
+    memmove(m_pending, m_pending + m_count, m_npending * sizeof(*m_pending));
+}
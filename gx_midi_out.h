@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_midi_out.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_MIDI_OUT_H_
+#define GX_MIDI_OUT_H_
+
+#include <atomic>
+
+#include "./gx_pitch_tracker.h"
+
+/* ------------- estimates as midi events ------------- */
+
+// Turns the estimates of up to 16 trackers into note on/off and pitch
+// bend on midi channel 1 .. 16, one per tracker. The note is the one
+// closest to the estimate, the bend carries the cents off it, with
+// the usual range of +-2 semitones by default. A note is only left
+// when the estimate is well past the half way mark to the next one,
+// so a note right between two doesn't flap.
+// The events of an estimate go out a fixed latency after the end of
+// its window, so they keep the timing of the input whenever the
+// analysis happens to finish; the ones due in a later period wait in a
+// queue.
+// process() runs in the jack process callback: no locks, no
+// allocation, the events come out sorted by their offset in the
+// period.
+
+struct MidiEvent {
+    // frames from the start of the period
+    unsigned int    offset;
+    unsigned char   data[3];
+    int             size;
+};
+
+class MidiOut {
+ public:
+    enum { MAX_CHANNELS = 16 };
+    explicit MidiOut();
+    // before process() runs
+    void            add(PitchTracker *tracker);
+    // A4 in Hz, from any thread
+    void            set_reference_pitch(double v) { m_reference.store(v); }
+    // semitones of a full pitch bend, as set up in the receiver
+    void            set_bend_range(int v) { m_bendRange = v < 1 ? 1 : v; }
+    int             get_bend_range() const { return m_bendRange; }
+    // frames from the end of an estimate's window to its events, at
+    // least a hop and a period, or an estimate which takes longer comes
+    // out late (at the start of the period). From any thread.
+    void            set_latency(int frames) { m_latency.store(frames); }
+    // the events for the new estimates, for a period of nframes frames
+    // which starts at frame time start
+    void            process(unsigned int start, int nframes);
+    // let the next process() turn off every note which still sounds,
+    // and send nothing after it. From any thread, stopped() is true
+    // once that period is written.
+    void            stop() { m_stop.store(true); }
+    bool            stopped() const { return m_stopped.load(); }
+    int             count() const { return m_count; }
+    const MidiEvent& event(int i) const { return m_events[i]; }
+ private:
+    // note off, bend and note on for every channel, for the periods
+    // of the latency
+    enum { MAX_EVENTS = 16 * 3 * MAX_CHANNELS };
+    struct Channel {
+        PitchTracker   *tracker;
+        // playing note, -1 == none
+        int             note;
+        int             bend;
+        // seq of the last estimate seen
+        unsigned int    seq;
+    };
+    // an event waiting for its period
+    struct Pending {
+        // jack frame time it is due
+        unsigned int    time;
+        unsigned char   data[3];
+    };
+    Channel         m_channels[MAX_CHANNELS];
+    int             m_nchannels;
+    std::atomic<double> m_reference;
+    int             m_bendRange;
+    std::atomic<int> m_latency;
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_stopped;
+    // sorted by time, events of the same time in the order they came
+    Pending         m_pending[MAX_EVENTS];
+    int             m_npending;
+    // the events of the current period, the last one may add a note
+    // off per channel to a full queue
+    MidiEvent       m_events[MAX_EVENTS + MAX_CHANNELS];
+    int             m_count;
+    void            update(int channel, const PitchResult& r, unsigned int time);
+    void            flush();
+    void            push(unsigned int time, int status, int data1, int data2);
+};
+
+#endif  // GX_MIDI_OUT_H_
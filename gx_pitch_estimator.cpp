@@ -0,0 +1,663 @@
+/*
+ * Copyright (C) 2009, 2010 Hermann Meyer, James Warden, Andreas Degert
+ * Copyright (C) 2011 Pete Shorthose
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_pitch_estimator.cpp      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+/****************************************************************
+ ** Pitch estimators of the tracker, the NSDF one is the method
+ ** the tracker always used (some code from tartini / Philip McLeod)
+ */
+
+#include "./gx_pitch_estimator.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// below this many multiply-adds per fft size and octave the direct
+// autocorrelation is cheaper than the two transforms of the fft path
+static const double DIRECT_ACF_COST = 4.0;
+// yin takes the first dip of the normalised difference below
+// YIN_THRESHOLD, or the deepest one when it is below YIN_MAX_DIP
+static const float YIN_THRESHOLD = 0.15;
+static const float YIN_MAX_DIP = 0.4;
+// harmonics multiplied by the hps, and its transform size per window
+static const int HPS_HARMONICS = 4;
+static const int HPS_OVERSAMPLE = 4;
+// share of the power in the harmonics below which hps finds no pitch
+static const float HPS_MIN_CLARITY = 0.3;
+static const float HPS_FLOOR = 1e-4;
+// cepstrum peak height over the mean below which it finds no pitch
+static const float CEPSTRUM_MIN_CLARITY = 0.5;
+// hps and cepstrum search from here when the window has no fmin, the
+// leakage of the lowest bins would win otherwise
+static const float SPECTRUM_MIN_FREQUENCY = 25.0;
+
+#define max(x, y) (((x) > (y)) ? (x) : (y))
+#define min(x, y) (((x) < (y)) ? (x) : (y))
+
+inline float sq(float x) {
+    return x * x;
+}
+
+/****************************************************************
+ ** fftw plans are measured once and the result is kept as fftw
+ ** wisdom in $XDG_CACHE_HOME/gxtuner, so later starts only load it.
+ */
+
+static std::string wisdom_dir() {
+    const char *cache = getenv("XDG_CACHE_HOME");
+    if (cache && *cache) {
+        return cache;
+    }
+    const char *home = getenv("HOME");
+    if (!home || !*home) {
+        return "";
+    }
+    return std::string(home) + "/.cache";
+}
+
+static fftwf_plan plan_r2r(int n, float *in, float *out, fftwf_r2r_kind kind) {
+    std::string dir = wisdom_dir();
+    std::string file = dir.empty() ? "" : dir + "/gxtuner/fftw-wisdom";
+    fftwf_plan plan = fftwf_plan_r2r_1d(n, in, out, kind,
+                                        FFTW_MEASURE | FFTW_WISDOM_ONLY);
+    if (plan) {
+        return plan;
+    }
+    // first run for this size, FFTW_MEASURE overwrites in and out
+    plan = fftwf_plan_r2r_1d(n, in, out, kind, FFTW_MEASURE);
+    if (plan && !file.empty()) {
+        mkdir(dir.c_str(), 0755);
+        mkdir((dir + "/gxtuner").c_str(), 0755);
+        // other instances may read the cache meanwhile, they see the
+        // old or the new one but never half of it
+        char pid[32];
+        snprintf(pid, sizeof(pid), ".%d", static_cast<int>(getpid()));
+        std::string tmp = file + pid;
+        if (!fftwf_export_wisdom_to_filename(tmp.c_str()) ||
+            rename(tmp.c_str(), file.c_str()) != 0) {
+            unlink(tmp.c_str());
+        }
+    }
+    return plan;
+}
+
+/****************************************************************
+ ** Trackers with the same fft size share their plans, they are
+ ** executed with fftwf_execute_r2r() on the buffers of each tracker
+ ** (all from fftwf_malloc(), so the alignment matches). The fftw
+ ** planner isn't thread safe, so planning happens under plan_mutex.
+ */
+
+struct SharedPlan {
+    int             size;
+    fftwf_r2r_kind  kind;
+    fftwf_plan      plan;
+    int             users;
+};
+
+static pthread_mutex_t plan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<SharedPlan> shared_plans;
+static bool wisdom_loaded = false;
+
+fftwf_plan gx_fft_acquire_plan(int n, float *in, float *out, fftwf_r2r_kind kind) {
+    pthread_mutex_lock(&plan_mutex);
+    fftwf_plan plan = 0;
+    for (unsigned int i = 0; i < shared_plans.size(); i++) {
+        if (shared_plans[i].size == n && shared_plans[i].kind == kind) {
+            shared_plans[i].users++;
+            plan = shared_plans[i].plan;
+            break;
+        }
+    }
+    if (!plan) {
+        if (!wisdom_loaded) {
+            std::string dir = wisdom_dir();
+            if (!dir.empty()) {
+                fftwf_import_wisdom_from_filename((dir + "/gxtuner/fftw-wisdom").c_str());
+            }
+            wisdom_loaded = true;
+        }
+        plan = plan_r2r(n, in, out, kind);
+        if (plan) {
+            SharedPlan p = { n, kind, plan, 1 };
+            shared_plans.push_back(p);
+        }
+    }
+    pthread_mutex_unlock(&plan_mutex);
+    return plan;
+}
+
+void gx_fft_release_plan(fftwf_plan plan) {
+    if (!plan) {
+        return;
+    }
+    pthread_mutex_lock(&plan_mutex);
+    for (unsigned int i = 0; i < shared_plans.size(); i++) {
+        if (shared_plans[i].plan == plan) {
+            if (--shared_plans[i].users == 0) {
+                fftwf_destroy_plan(plan);
+                shared_plans.erase(shared_plans.begin() + i);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&plan_mutex);
+}
+// The autocorrelation needs at least size + (size+1)/2
+// points to keep the lags of interest free of circular wrap around,
+// fftw is fastest for sizes with small prime factors.
+int PitchEstimator::fft_size(int size, int padding) {
+    int n = size + (size+1) / 2;
+    if (padding == FFT_PAD_POW2) {
+        int m = 1;
+        while (m < n) {
+            m <<= 1;
+        }
+        return m;
+    }
+    if (padding == FFT_PAD_SMOOTH) {
+        for (int m = n; ; m++) {
+            int r = m;
+            while (r % 2 == 0) r /= 2;
+            while (r % 3 == 0) r /= 3;
+            while (r % 5 == 0) r /= 5;
+            if (r == 1) {
+                return m;
+            }
+        }
+    }
+    return n;
+}
+
+inline void parabolaTurningPoint(float y_1, float y0, float y1, float xOffset, float *x) {
+    float yTop = y_1 - y1;
+    float yBottom = y1 + y_1 - 2 * y0;
+    if (yBottom != 0.0) {
+        *x = xOffset + yTop / (2 * yBottom);
+    } else {
+        *x = xOffset;
+    }
+}
+
+static int findMaxima(float *input, int len, int *maxPositions, int *length, int maxLen) {
+    int pos = 0;
+    int curMaxPos = 0;
+    int overallMaxIndex = 0;
+
+    while (pos < (len-1)/3 && input[pos] > 0.0) {
+        pos += 1;  // find the first negitive zero crossing
+    }
+    while (pos < len-1 && input[pos] <= 0.0) {
+        pos += 1;  // loop over all the values below zero
+    }
+    if (pos == 0) {
+        pos = 1;  // can happen if output[0] is NAN
+    }
+    while (pos < len-1) {
+        if (input[pos] > input[pos-1] && input[pos] >= input[pos+1]) {  // a local maxima
+            if (curMaxPos == 0) {
+                curMaxPos = pos;  // the first maxima (between zero crossings)
+            } else if (input[pos] > input[curMaxPos]) {
+                curMaxPos = pos;  // a higher maxima (between the zero crossings)
+            }
+        }
+        pos += 1;
+        if (pos < len-1 && input[pos] <= 0.0) {  // a negative zero crossing
+            if (curMaxPos > 0) {  // if there was a maximum
+                maxPositions[*length] = curMaxPos;  // add it to the vector of maxima
+                *length += 1;
+                if (overallMaxIndex == 0) {
+                    overallMaxIndex = curMaxPos;
+                } else if (input[curMaxPos] > input[overallMaxIndex]) {
+                    overallMaxIndex = curMaxPos;
+                }
+                if (*length >= maxLen) {
+                    return overallMaxIndex;
+                }
+                curMaxPos = 0;  // clear the maximum position, so we start looking for a new ones
+            }
+            while (pos < len-1 && input[pos] <= 0.0) {
+                pos += 1;  // loop over all the values below zero
+            }
+        }
+    }
+    if (curMaxPos > 0) {  // if there was a maximum in the last part
+        maxPositions[*length] = curMaxPos;  // add it to the vector of maxima
+        *length += 1;
+        if (overallMaxIndex == 0) {
+            overallMaxIndex = curMaxPos;
+        } else if (input[curMaxPos] > input[overallMaxIndex]) {
+            overallMaxIndex = curMaxPos;
+        }
+        curMaxPos = 0;  // clear the maximum position, so we start looking for a new ones
+    }
+    return overallMaxIndex;
+}
+
+static int findsubMaximum(float *input, int len, float threshold) {
+    int indices[10];
+    int length = 0;
+    int overallMaxIndex = findMaxima(input, len, indices, &length, 10);
+    if (length == 0) {
+        return -1;
+    }
+    threshold += (1.0 - threshold) * (1.0 - input[overallMaxIndex]);
+    float cutoff = input[overallMaxIndex] * threshold;
+    for (int j = 0; j < length; j++) {
+        if (input[indices[j]] >= cutoff) {
+            return indices[j];
+        }
+    }
+    // should never get here
+    return -1;
+}
+
+PitchEstimator *PitchEstimator::create(const std::string& name) {
+    if (name == "nsdf") {
+        return new NsdfEstimator;
+    }
+    if (name == "yin") {
+        return new YinEstimator;
+    }
+    if (name == "hps") {
+        return new HpsEstimator;
+    }
+    if (name == "cepstrum") {
+        return new CepstrumEstimator;
+    }
+    return 0;
+}
+
+/****************************************************************
+ ** FftEstimator
+ */
+
+FftEstimator::FftEstimator()
+    : m_count(0),
+      m_sizes(),
+      m_fftSizes(),
+      m_fftwPlanFFT(),
+      m_fftwPlanIFFT(),
+      m_fftwBufferTime(0),
+      m_fftwBufferFreq(0),
+      m_bufferSize(0) {
+}
+
+FftEstimator::~FftEstimator() {
+    release();
+}
+
+void FftEstimator::release() {
+    for (int i = 0; i < m_count; i++) {
+        gx_fft_release_plan(m_fftwPlanFFT[i]);
+        gx_fft_release_plan(m_fftwPlanIFFT[i]);
+        m_fftwPlanFFT[i] = m_fftwPlanIFFT[i] = 0;
+    }
+    m_count = 0;
+    fftwf_free(m_fftwBufferTime);
+    fftwf_free(m_fftwBufferFreq);
+    m_fftwBufferTime = m_fftwBufferFreq = 0;
+    m_bufferSize = 0;
+}
+
+bool FftEstimator::setup(const int *sizes, int count, int padding) {
+    release();
+    int n = 0;
+    for (int i = 0; i < count && i < MAX_SIZES; i++) {
+        m_sizes[i] = sizes[i];
+        m_fftSizes[i] = transform_size(sizes[i], padding);
+        n = max(n, max(m_fftSizes[i], sizes[i]));
+    }
+    m_bufferSize = n;
+    m_fftwBufferTime = reinterpret_cast<float*>(fftwf_malloc(n * sizeof(*m_fftwBufferTime)));
+    m_fftwBufferFreq = reinterpret_cast<float*>(fftwf_malloc(n * sizeof(*m_fftwBufferFreq)));
+    if (!m_fftwBufferTime || !m_fftwBufferFreq) {
+        return false;
+    }
+    memset(m_fftwBufferTime, 0, n * sizeof(*m_fftwBufferTime));
+    memset(m_fftwBufferFreq, 0, n * sizeof(*m_fftwBufferFreq));
+    bool ok = true;
+    for (int i = 0; i < count && i < MAX_SIZES; i++) {
+        m_fftwPlanFFT[i] = gx_fft_acquire_plan(
+                               m_fftSizes[i], m_fftwBufferTime, m_fftwBufferFreq,
+                               FFTW_R2HC);
+        m_fftwPlanIFFT[i] = gx_fft_acquire_plan(
+                                m_fftSizes[i], m_fftwBufferFreq, m_fftwBufferTime,
+                                FFTW_HC2R);
+        m_count = i + 1;
+        if (!m_fftwPlanFFT[i] || !m_fftwPlanIFFT[i]) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int FftEstimator::find(int size) const {
+    for (int i = 0; i < m_count; i++) {
+        if (m_sizes[i] == size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/****************************************************************
+ ** AcfEstimator
+ */
+
+// lags above the period of the lowest frequency of interest
+// are not examined (+2 for the parabolic interpolation)
+int AcfEstimator::lag_count(const AnalysisWindow& w) {
+    int count = (w.size + 1) / 2;
+    if (w.fmin > 0) {
+        count = min(count, static_cast<int>(w.sampleRate / w.fmin) + 2);
+    }
+    return count;
+}
+
+void AcfEstimator::autocorrelation(const AnalysisWindow& w, int lags) {
+    int i = find(w.size);
+    if (i < 0 || static_cast<double>(lags) * w.size <
+            DIRECT_ACF_COST * m_fftSizes[i] * log2(m_fftSizes[i])) {
+        autocorrelation_direct(w, lags);
+    } else {
+        autocorrelation_fft(w, i);
+    }
+}
+
+// m_fftwBufferTime[k] := r(k+1) for k < (size+1)/2, computed by fft
+// (zero padded to avoid circular wrap around).
+void AcfEstimator::autocorrelation_fft(const AnalysisWindow& w, int index) {
+    const int size = w.size;
+    const int fftSize = m_fftSizes[index];
+    memcpy(m_fftwBufferTime, w.input, size * sizeof(*m_fftwBufferTime));
+    memset(m_fftwBufferTime+size, 0, (fftSize - size) * sizeof(*m_fftwBufferTime));
+    fftwf_execute_r2r(m_fftwPlanFFT[index], m_fftwBufferTime, m_fftwBufferFreq);
+    for (int k = 1; k < fftSize/2; k++) {
+        m_fftwBufferFreq[k] = sq(m_fftwBufferFreq[k]) + sq(m_fftwBufferFreq[fftSize-k]);
+        m_fftwBufferFreq[fftSize-k] = 0.0;
+    }
+    m_fftwBufferFreq[0] = sq(m_fftwBufferFreq[0]);
+    m_fftwBufferFreq[fftSize/2] = sq(m_fftwBufferFreq[fftSize/2]);
+
+    fftwf_execute_r2r(m_fftwPlanIFFT[index], m_fftwBufferFreq, m_fftwBufferTime);
+
+    // fftw doesn't normalise, scale by the (padded) transform size
+    int count = (size + 1) / 2;
+    for (int k = 0; k < count; k++) {
+        m_fftwBufferTime[k] = m_fftwBufferTime[k+1] / static_cast<float>(fftSize);
+    }
+}
+
+// m_fftwBufferTime[k] := r(k+1) for k < lags, computed in the time
+// domain, cheaper than the fft when only a few lags are needed.
+void AcfEstimator::autocorrelation_direct(const AnalysisWindow& w, int lags) {
+    const float *input = w.input;
+    for (int k = 0; k < lags; k++) {
+        const float *shifted = input + k + 1;
+        int n = w.size - k - 1;
+        float sum = 0.0;
+        for (int j = 0; j < n; j++) {
+            sum += input[j] * shifted[j];
+        }
+        m_fftwBufferTime[k] = sum;
+    }
+}
+
+/****************************************************************
+ ** NsdfEstimator
+ */
+
+float NsdfEstimator::estimate(const AnalysisWindow& w, float *clarity) {
+    *clarity = 0.0;
+    int count = lag_count(w);
+    if (count < 3 || m_bufferSize < count) {
+        return 0.0;
+    }
+    autocorrelation(w, count);
+
+    // energy[j] - energy[-1] is the energy of input[0..j], so the
+    // normalisation term m'(k+1) = sum over input[0..n-k-2] and
+    // input[k+1..n-1] of x*x comes straight from the running sums.
+    const double *energy = w.energy;
+    for (int k = 0; k < count; k++) {
+        double sumSq = w.windowEnergy + energy[w.size-2-k] - energy[k];
+        // dividing by zero is very slow, so deal with it seperately
+        if (sumSq > 0.0) {
+            m_fftwBufferTime[k] *= 2.0 / sumSq;
+        } else {
+            m_fftwBufferTime[k] = 0.0;
+        }
+    }
+    const float thres = 0.99; // was 0.6
+    int maxAutocorrIndex = findsubMaximum(m_fftwBufferTime, count, thres);
+    if (maxAutocorrIndex < 0) {
+        return 0.0;
+    }
+    float x = 0.0;
+    *clarity = min(1.0f, m_fftwBufferTime[maxAutocorrIndex]);
+    parabolaTurningPoint(m_fftwBufferTime[maxAutocorrIndex-1],
+                         m_fftwBufferTime[maxAutocorrIndex],
+                         m_fftwBufferTime[maxAutocorrIndex+1],
+                         maxAutocorrIndex+1, &x);
+    return w.sampleRate / x;
+}
+
+/****************************************************************
+ ** YinEstimator
+ */
+
+float YinEstimator::estimate(const AnalysisWindow& w, float *clarity) {
+    *clarity = 0.0;
+    int count = lag_count(w);
+    if (count < 3 || m_bufferSize < count) {
+        return 0.0;
+    }
+    autocorrelation(w, count);
+
+    // difference d(k+1) = m'(k+1) - 2 r(k+1), scaled to the full window
+    // as the overlap gets shorter, then divided by its running mean
+    const double *energy = w.energy;
+    float *d = m_fftwBufferTime;
+    double sum = 0.0;
+    for (int k = 0; k < count; k++) {
+        double sumSq = w.windowEnergy + energy[w.size-2-k] - energy[k];
+        double diff = max(0.0, sumSq - 2.0 * d[k]) * w.size / (w.size - k - 1);
+        sum += diff;
+        d[k] = (sum > 0.0) ? diff * (k + 1) / sum : 1.0;
+    }
+    // the first dip below the threshold, else the deepest one
+    int first = max(1, static_cast<int>(w.sampleRate / w.fmax) - 1);
+    int best = -1;
+    for (int k = first; k < count - 1; k++) {
+        if (d[k] < YIN_THRESHOLD) {
+            while (k + 1 < count - 1 && d[k+1] < d[k]) {
+                k++;
+            }
+            best = k;
+            break;
+        }
+        if (best < 0 || d[k] < d[best]) {
+            best = k;
+        }
+    }
+    if (best < 1 || d[best] >= YIN_MAX_DIP) {
+        return 0.0;
+    }
+    float x = 0.0;
+    *clarity = max(0.0f, 1.0f - d[best]);
+    parabolaTurningPoint(d[best-1], d[best], d[best+1], best+1, &x);
+    return w.sampleRate / x;
+}
+
+/****************************************************************
+ ** HpsEstimator
+ */
+
+// finer bins than the autocorrelation needs, the peak is interpolated
+int HpsEstimator::transform_size(int size, int padding) {
+    return fft_size(HPS_OVERSAMPLE * size * 2 / 3, padding);
+}
+
+float HpsEstimator::estimate(const AnalysisWindow& w, float *clarity) {
+    *clarity = 0.0;
+    int i = find(w.size);
+    if (i < 0) {
+        return 0.0;
+    }
+    const int n = m_fftSizes[i];
+    // hann window, zero padded
+    for (int j = 0; j < w.size; j++) {
+        m_fftwBufferTime[j] = w.input[j] * (0.5 - 0.5 * cos(2 * M_PI * j / w.size));
+    }
+    memset(m_fftwBufferTime+w.size, 0, (n - w.size) * sizeof(*m_fftwBufferTime));
+    fftwf_execute_r2r(m_fftwPlanFFT[i], m_fftwBufferTime, m_fftwBufferFreq);
+    // power spectrum into m_fftwBufferTime[0 .. n/2]
+    float *p = m_fftwBufferTime;
+    double total = 0.0;
+    float peakPower = 0.0;
+    p[0] = sq(m_fftwBufferFreq[0]);
+    for (int k = 1; k < n/2; k++) {
+        p[k] = sq(m_fftwBufferFreq[k]) + sq(m_fftwBufferFreq[n-k]);
+        total += p[k];
+        peakPower = max(peakPower, p[k]);
+    }
+    p[n/2] = sq(m_fftwBufferFreq[n/2]);
+    if (total <= 0.0) {
+        return 0.0;
+    }
+    // sum of the log power at the first HPS_HARMONICS multiples, a
+    // missing harmonic only costs down to HPS_FLOOR below the peak
+    const float floor = peakPower * HPS_FLOOR;
+    const double binHz = static_cast<double>(w.sampleRate) / n;
+    int kmin = max(2, static_cast<int>(max(w.fmin, SPECTRUM_MIN_FREQUENCY) / binHz));
+    int kmax = min(static_cast<int>(w.fmax / binHz) + 1, n / 2 / HPS_HARMONICS - 1);
+    int best = -1;
+    float bestSum = 0.0;
+    for (int k = kmin; k <= kmax; k++) {
+        float s = 0.0;
+        for (int h = 1; h <= HPS_HARMONICS; h++) {
+            s += logf(max(p[h*k], floor));
+        }
+        if (best < 0 || s > bestSum) {
+            best = k;
+            bestSum = s;
+        }
+    }
+    if (best < 0) {
+        return 0.0;
+    }
+    // interpolate at the strongest harmonic, its peak is the sharpest
+    int harmonic = 1;
+    int peak = best;
+    double harmonicPower = 0.0;
+    for (int h = 1; h <= HPS_HARMONICS; h++) {
+        int k = h * best;
+        if (p[k+1] > p[k]) k++;
+        if (p[k-1] > p[k]) k--;
+        // the main lobe of the hann window, HPS_OVERSAMPLE bins each side
+        for (int j = max(1, k - HPS_OVERSAMPLE); j <= min(n/2, k + HPS_OVERSAMPLE); j++) {
+            harmonicPower += p[j];
+        }
+        if (p[k] > p[peak]) {
+            peak = k;
+            harmonic = h;
+        }
+    }
+    if (peak < 1 || peak >= n/2) {
+        return 0.0;
+    }
+    float x = 0.0;
+    parabolaTurningPoint(logf(p[peak-1] + 1e-20f), logf(p[peak] + 1e-20f),
+                         logf(p[peak+1] + 1e-20f), peak, &x);
+    *clarity = min(1.0, harmonicPower / total);
+    if (*clarity < HPS_MIN_CLARITY) {
+        *clarity = 0.0;
+        return 0.0;
+    }
+    return x * binHz / harmonic;
+}
+
+/****************************************************************
+ ** CepstrumEstimator
+ */
+
+float CepstrumEstimator::estimate(const AnalysisWindow& w, float *clarity) {
+    *clarity = 0.0;
+    int i = find(w.size);
+    if (i < 0) {
+        return 0.0;
+    }
+    const int n = m_fftSizes[i];
+    for (int j = 0; j < w.size; j++) {
+        m_fftwBufferTime[j] = w.input[j] * (0.5 - 0.5 * cos(2 * M_PI * j / w.size));
+    }
+    memset(m_fftwBufferTime+w.size, 0, (n - w.size) * sizeof(*m_fftwBufferTime));
+    fftwf_execute_r2r(m_fftwPlanFFT[i], m_fftwBufferTime, m_fftwBufferFreq);
+    // log power spectrum, real and even, so the cepstrum comes out real
+    float *f = m_fftwBufferFreq;
+    f[0] = logf(sq(f[0]) + 1e-20f);
+    for (int k = 1; k < n/2; k++) {
+        f[k] = logf(sq(f[k]) + sq(f[n-k]) + 1e-20f);
+        f[n-k] = 0.0;
+    }
+    f[n/2] = logf(sq(f[n/2]) + 1e-20f);
+    fftwf_execute_r2r(m_fftwPlanIFFT[i], m_fftwBufferFreq, m_fftwBufferTime);
+
+    const float *c = m_fftwBufferTime;
+    int qmin = max(2, static_cast<int>(w.sampleRate / w.fmax));
+    int qmax = min(w.size / 2, n / 2 - 2);
+    qmax = min(qmax, static_cast<int>(w.sampleRate / max(w.fmin, SPECTRUM_MIN_FREQUENCY)) + 1);
+    if (qmax <= qmin) {
+        return 0.0;
+    }
+    int best = qmin;
+    double mean = 0.0;
+    for (int q = qmin; q <= qmax; q++) {
+        mean += fabs(c[q]);
+        if (c[q] > c[best]) {
+            best = q;
+        }
+    }
+    mean /= (qmax - qmin + 1);
+    if (c[best] <= 0.0) {
+        return 0.0;
+    }
+    // how far the peak stands out of the rest of the quefrencies
+    *clarity = max(0.0, 1.0 - mean / c[best]);
+    if (*clarity < CEPSTRUM_MIN_CLARITY) {
+        *clarity = 0.0;
+        return 0.0;
+    }
+    float x = 0.0;
+    parabolaTurningPoint(c[best-1], c[best], c[best+1], best, &x);
+    return w.sampleRate / x;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_pitch_estimator.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_PITCH_ESTIMATOR_H_
+#define GX_PITCH_ESTIMATOR_H_
+
+#include <fftw3.h>
+
+#include <string>
+
+/* ------------- shared fftw plans ------------- */
+
+// Plans are measured once, kept as fftw wisdom in $XDG_CACHE_HOME/gxtuner
+// and shared by everyone asking for the same size and kind. in and out
+// must come from fftwf_malloc(), the plan is executed with
+// fftwf_execute_r2r() on any such buffers. Not realtime safe.
+fftwf_plan gx_fft_acquire_plan(int n, float *in, float *out, fftwf_r2r_kind kind);
+void gx_fft_release_plan(fftwf_plan plan);
+
+/* ------------- pitch estimators ------------- */
+
+// one analysis window as the tracker hands it to an estimator
+struct AnalysisWindow {
+    const float    *input;
+    int             size;
+    // running sum of x*x: energy[j] minus the sum in front of the
+    // window is the energy of input[0..j]
+    const double   *energy;
+    // energy of the whole window
+    double          windowEnergy;
+    int             sampleRate;
+    // frequency range to search (Hz)
+    float           fmin;
+    float           fmax;
+};
+
+// The estimators only run in the analysis thread, one instance per
+// tracker and path, so they keep their work buffers to themselves.
+
+class PitchEstimator {
+ public:
+    // zero padding of the fft, see fft_size()
+    enum { FFT_PAD_MIN, FFT_PAD_SMOOTH, FFT_PAD_POW2 };
+    static int      fft_size(int size, int padding);
+    // "nsdf", "yin", "hps" or "cepstrum", 0 for an unknown name
+    static PitchEstimator *create(const std::string& name);
+    virtual ~PitchEstimator() {}
+    virtual const char *name() const = 0;
+    // get plans and buffers for windows of the given sizes, not
+    // realtime safe
+    virtual bool    setup(const int *sizes, int count, int padding) = 0;
+    // pitch of the window in Hz, 0 == none, and how sure it is (0 .. 1)
+    virtual float   estimate(const AnalysisWindow& w, float *clarity) = 0;
+};
+
+// fft plans and buffers for a few window sizes
+class FftEstimator : public PitchEstimator {
+ protected:
+    enum { MAX_SIZES = 4 };
+    int             m_count;
+    int             m_sizes[MAX_SIZES];
+    int             m_fftSizes[MAX_SIZES];
+    fftwf_plan      m_fftwPlanFFT[MAX_SIZES];
+    fftwf_plan      m_fftwPlanIFFT[MAX_SIZES];
+    // time and frequency domain work buffers, from fftwf_malloc()
+    float          *m_fftwBufferTime;
+    float          *m_fftwBufferFreq;
+    int             m_bufferSize;
+    // index of a window size given to setup(), -1 if there is none
+    int             find(int size) const;
+    // transform size for a window
+    virtual int     transform_size(int size, int padding) {
+        return fft_size(size, padding);
+    }
+    void            release();
+ public:
+    explicit FftEstimator();
+    virtual ~FftEstimator();
+    virtual bool    setup(const int *sizes, int count, int padding);
+};
+
+// estimators built on the autocorrelation r(k)
+class AcfEstimator : public FftEstimator {
+ protected:
+    // lags to examine for the frequency range of the window
+    static int      lag_count(const AnalysisWindow& w);
+    // m_fftwBufferTime[k] := r(k+1) for k < lags, by fft or in the
+    // time domain, whichever is cheaper
+    void            autocorrelation(const AnalysisWindow& w, int lags);
+    void            autocorrelation_fft(const AnalysisWindow& w, int index);
+    void            autocorrelation_direct(const AnalysisWindow& w, int lags);
+};
+
+// normalised square difference function, McLeod / tartini
+class NsdfEstimator : public AcfEstimator {
+ public:
+    virtual const char *name() const { return "nsdf"; }
+    virtual float   estimate(const AnalysisWindow& w, float *clarity);
+};
+
+// cumulative mean normalised difference, de Cheveigné / Kawahara
+class YinEstimator : public AcfEstimator {
+ public:
+    virtual const char *name() const { return "yin"; }
+    virtual float   estimate(const AnalysisWindow& w, float *clarity);
+};
+
+// harmonic product spectrum, cheap but coarse for the low notes
+class HpsEstimator : public FftEstimator {
+ protected:
+    virtual int     transform_size(int size, int padding);
+ public:
+    virtual const char *name() const { return "hps"; }
+    virtual float   estimate(const AnalysisWindow& w, float *clarity);
+};
+
+// peak of the real cepstrum, needs notes rich in harmonics
+class CepstrumEstimator : public FftEstimator {
+ public:
+    virtual const char *name() const { return "cepstrum"; }
+    virtual float   estimate(const AnalysisWindow& w, float *clarity);
+};
+
+#endif  // GX_PITCH_ESTIMATOR_H_
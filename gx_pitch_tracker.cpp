@@ -30,19 +30,78 @@
 
 #include "./gx_pitch_tracker.h"
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GX_HAVE_X86_SIMD 1
+#endif
+
 // downsampling factor
 static const int DOWNSAMPLE = 2;
 static const float SIGNAL_THRESHOLD_ON = 0.001;
 static const float SIGNAL_THRESHOLD_OFF = 0.0009;
 static const float TRACKER_PERIOD = 0.1;
-// The size of the read buffer
+// precision drops above 1000 Hz
+static const float MAX_FREQUENCY = 1060.0;
+// while the level gate is open the high path at the jack rate is asked
+// when the decimated path finds no pitch or one above HIGH_ENGAGE, and
+// wins from HIGH_CROSSOVER
+static const float HIGH_ENGAGE = 800.0;
+static const float HIGH_CROSSOVER = 900.0;
+static const float HIGH_MAX_FREQUENCY = 4200.0;
+// unfiltered / pre-filtered rms above which the high path checks
+// whether a lower estimate (above HIGH_ENGAGE / 4) is a subharmonic
+static const float HIGH_LEVEL_RATIO = 2.0;
+// length of the high path window (seconds), limited to HIGH_MAX_WINDOW
+static const float HIGH_WINDOW_TIME = 0.02;
+static const int HIGH_MAX_WINDOW = 4096;
+static const int HIGH_HISTORY_SIZE = 2 * HIGH_MAX_WINDOW;
+// add() looks at the energy of blocks of ONSET_BLOCK_TIME seconds, one
+// ONSET_RATIO times above the envelope of the blocks before is the
+// attack of a note. The envelope follows a rise at once and falls with
+// a time constant of ONSET_RELEASE seconds.
+static const float ONSET_BLOCK_TIME = 0.005;
+static const float ONSET_RATIO = 4.0;
+static const float ONSET_RELEASE = 0.1;
+// after an onset the hop is ONSET_HOP_DIVISOR times shorter for
+// ONSET_HOLD seconds, while a note sustains or the input is silent it
+// is SUSTAIN_HOP_FACTOR or SILENCE_HOP_FACTOR times longer
+static const float ONSET_HOLD = 0.25;
+static const int ONSET_HOP_DIVISOR = 4;
+static const int SUSTAIN_HOP_FACTOR = 2;
+static const int SILENCE_HOP_FACTOR = 4;
+// the analysis thread looks for an onset at least this often (seconds)
+static const double ONSET_POLL = 0.005;
+// an idle analysis is woken when the gate opens, it looks on its own
+// this often (s) to drop what add() wrote, long before the ring buffer
+// is full
+static const double IDLE_WAIT = 0.25;
+// The default size of the analysis window
 static const int FFT_SIZE = 2048;
+// a shorter window is used once it holds this many periods of the
+// steady note, and left when it holds less than WINDOW_PERIODS
+static const float WINDOW_PERIODS = 6.0;
+static const float WINDOW_HYSTERESIS = 1.25;
+static const int WINDOW_STEADY = 3;
+static const float WINDOW_MIN_CLARITY = 0.9;
+// limits for the analysis window
+static const int MIN_WINDOW_SIZE = 256;
+static const int MAX_WINDOW_SIZE = 2 * FFT_SIZE;
+// The size of the ring buffer between jack and tracker thread
+static const int RINGBUFFER_SIZE = 4 * MAX_WINDOW_SIZE;
+// samples after which the running sums get rebased to keep precision
+static const int REBASE_PERIOD = 16 * MAX_WINDOW_SIZE;
+// scratch size of add() until set_max_period() is called
+static const int DEFAULT_PERIOD = 1024;
 
 #define max(x, y) (((x) > (y)) ? (x) : (y))
 #define min(x, y) (((x) < (y)) ? (x) : (y))
 
 
-inline void Dsp::clear_state_f()
+void Dsp::clear_state_f()
 {
 	for (int i=0; i<2; i++) iVec0[i] = 0;
 	for (int i=0; i<2; i++) fRec4[i] = 0;
@@ -51,9 +110,13 @@ inline void Dsp::clear_state_f()
 	for (int i=0; i<2; i++) fRec2[i] = 0;
 	for (int i=0; i<3; i++) fRec1[i] = 0;
 	for (int i=0; i<3; i++) fRec0[i] = 0;
+	for (int i=0; i<4; i++) fS1[i] = 0;
+	for (int i=0; i<4; i++) fS2[i] = 0;
+	for (int i=0; i<4; i++) fY[i] = 0;
+	fDenormal = 1e-20;
 }
 
-inline void Dsp::init(int samplingFreq)
+void Dsp::init(int samplingFreq, int simd_max)
 {
 	fSamplingFreq = samplingFreq;
 	iConst0 = min(192000, max(1, fSamplingFreq));
@@ -67,10 +130,54 @@ inline void Dsp::init(int samplingFreq)
 	fConst8 = (72.25663103256524 / double(iConst0));
 	fConst9 = (1 - fConst8);
 	fConst10 = (1.0 / (1 + fConst8));
+	// two 1st order highpass sections
+	for (int i=0; i<2; i++) {
+		fB0[i] = fConst10;
+		fB1[i] = -fConst10;
+		fB2[i] = 0;
+		fA1[i] = -(fConst10 * fConst9);
+		fA2[i] = 0;
+	}
+	// two 2nd order lowpass sections
+	fB0[2] = fConst7;
+	fB1[2] = 2 * fConst7;
+	fB2[2] = fConst7;
+	fA1[2] = fConst7 * fConst2;
+	fA2[2] = fConst7 * fConst6;
+	fB0[3] = fConst5;
+	fB1[3] = 2 * fConst5;
+	fB2[3] = fConst5;
+	fA1[3] = fConst5 * fConst2;
+	fA2[3] = fConst5 * fConst4;
+	iSimd = SIMD_NONE;
+#ifdef GX_HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (simd_max >= SIMD_AVX2 && __builtin_cpu_supports("avx2")
+			&& __builtin_cpu_supports("fma")) {
+		iSimd = SIMD_AVX2;
+	} else if (simd_max >= SIMD_SSE2 && __builtin_cpu_supports("sse2")) {
+		iSimd = SIMD_SSE2;
+	}
+#endif
 	clear_state_f();
 }
 
 void Dsp::compute(int count, float *input0, float *output0)
+{
+	switch (iSimd) {
+	case SIMD_AVX2:
+		compute_avx2(count, input0, output0);
+		break;
+	case SIMD_SSE2:
+		compute_sse2(count, input0, output0);
+		break;
+	default:
+		compute_scalar(count, input0, output0);
+		break;
+	}
+}
+
+void Dsp::compute_scalar(int count, float *input0, float *output0)
 {
 	for (int i=0; i<count; i++) {
 		iVec0[0] = 1;
@@ -93,6 +200,86 @@ void Dsp::compute(int count, float *input0, float *output0)
 	}
 }
 
+/*
+ * The sections depend on each other, so the simd versions run them as a
+ * pipeline: per sample, lane k filters the sample lane k-1 produced one
+ * step earlier. Lane 3 therefore delivers the output 3 samples late,
+ * the transfer function is the same.
+ */
+
+#ifdef GX_HAVE_X86_SIMD
+__attribute__((target("sse2")))
+void Dsp::compute_sse2(int count, float *input0, float *output0)
+{
+	// lane 0, 1 in a, lane 2, 3 in b
+	const __m128d b0a = _mm_loadu_pd(&fB0[0]), b0b = _mm_loadu_pd(&fB0[2]);
+	const __m128d b1a = _mm_loadu_pd(&fB1[0]), b1b = _mm_loadu_pd(&fB1[2]);
+	const __m128d b2a = _mm_loadu_pd(&fB2[0]), b2b = _mm_loadu_pd(&fB2[2]);
+	const __m128d a1a = _mm_loadu_pd(&fA1[0]), a1b = _mm_loadu_pd(&fA1[2]);
+	const __m128d a2a = _mm_loadu_pd(&fA2[0]), a2b = _mm_loadu_pd(&fA2[2]);
+	__m128d s1a = _mm_loadu_pd(&fS1[0]), s1b = _mm_loadu_pd(&fS1[2]);
+	__m128d s2a = _mm_loadu_pd(&fS2[0]), s2b = _mm_loadu_pd(&fS2[2]);
+	__m128d ya = _mm_loadu_pd(&fY[0]), yb = _mm_loadu_pd(&fY[2]);
+	double dn = fDenormal;
+	for (int i=0; i<count; i++) {
+		__m128d ua = _mm_unpacklo_pd(_mm_set_sd((double)input0[i] + dn), ya);
+		__m128d ub = _mm_shuffle_pd(ya, yb, 1);
+		dn = -dn;
+		ya = _mm_add_pd(_mm_mul_pd(b0a, ua), s1a);
+		yb = _mm_add_pd(_mm_mul_pd(b0b, ub), s1b);
+		s1a = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(b1a, ua), s2a), _mm_mul_pd(a1a, ya));
+		s1b = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(b1b, ub), s2b), _mm_mul_pd(a1b, yb));
+		s2a = _mm_sub_pd(_mm_mul_pd(b2a, ua), _mm_mul_pd(a2a, ya));
+		s2b = _mm_sub_pd(_mm_mul_pd(b2b, ub), _mm_mul_pd(a2b, yb));
+		output0[i] = (float)_mm_cvtsd_f64(_mm_unpackhi_pd(yb, yb));
+	}
+	_mm_storeu_pd(&fS1[0], s1a); _mm_storeu_pd(&fS1[2], s1b);
+	_mm_storeu_pd(&fS2[0], s2a); _mm_storeu_pd(&fS2[2], s2b);
+	_mm_storeu_pd(&fY[0], ya); _mm_storeu_pd(&fY[2], yb);
+	fDenormal = dn;
+}
+
+__attribute__((target("avx2,fma")))
+void Dsp::compute_avx2(int count, float *input0, float *output0)
+{
+	const __m256d b0 = _mm256_loadu_pd(fB0);
+	const __m256d b1 = _mm256_loadu_pd(fB1);
+	const __m256d b2 = _mm256_loadu_pd(fB2);
+	const __m256d a1 = _mm256_loadu_pd(fA1);
+	const __m256d a2 = _mm256_loadu_pd(fA2);
+	__m256d s1 = _mm256_loadu_pd(fS1);
+	__m256d s2 = _mm256_loadu_pd(fS2);
+	__m256d y = _mm256_loadu_pd(fY);
+	double dn = fDenormal;
+	for (int i=0; i<count; i++) {
+		// lane k gets the last output of lane k-1, lane 0 the new sample
+		__m256d u = _mm256_permute4x64_pd(y, _MM_SHUFFLE(2, 1, 0, 0));
+		u = _mm256_blend_pd(u, _mm256_set1_pd((double)input0[i] + dn), 1);
+		dn = -dn;
+		y = _mm256_fmadd_pd(b0, u, s1);
+		s1 = _mm256_fnmadd_pd(a1, y, _mm256_fmadd_pd(b1, u, s2));
+		s2 = _mm256_fnmadd_pd(a2, y, _mm256_mul_pd(b2, u));
+		__m128d hi = _mm256_extractf128_pd(y, 1);
+		output0[i] = (float)_mm_cvtsd_f64(_mm_unpackhi_pd(hi, hi));
+	}
+	_mm256_storeu_pd(fS1, s1);
+	_mm256_storeu_pd(fS2, s2);
+	_mm256_storeu_pd(fY, y);
+	fDenormal = dn;
+}
+#else
+void Dsp::compute_sse2(int count, float *input0, float *output0)
+{
+	compute_scalar(count, input0, output0);
+}
+
+void Dsp::compute_avx2(int count, float *input0, float *output0)
+{
+	compute_scalar(count, input0, output0);
+}
+#endif
+
+
 
 void *PitchTracker::static_run(void *p) {
     (reinterpret_cast<PitchTracker *>(p))->run();
@@ -101,38 +288,86 @@ void *PitchTracker::static_run(void *p) {
 
 PitchTracker::PitchTracker()
     : error(false),
-      busy(false),
-      tick(0),
       m_pthr(0),
+      m_threaded(true),
       resamp(),
+      m_decimator(),
+      m_decimate(false),
+      m_nativeRate(false),
       m_sampleRate(),
       fixed_sampleRate(41000),
       m_freq(-1),
+      m_resultSeq(0),
+      m_resultFreq(0),
+      m_resultClarity(0),
+      m_resultRms(0),
+      m_resultFrame(0),
+      m_anchor(0),
+      m_highHistory(),
+      m_highAnchor(0),
+      m_highWindow(new float[HIGH_MAX_WINDOW]),
+      m_highEnergy(new double[HIGH_MAX_WINDOW]),
+      m_highWindowSize(0),
+      m_filterBuffer(new float[DEFAULT_PERIOD]),
+      m_filterBufferSize(DEFAULT_PERIOD),
+      m_inputDelay(0),
+      m_inputRate(0),
       signal_threshold_on(SIGNAL_THRESHOLD_ON),
       signal_threshold_off(SIGNAL_THRESHOLD_OFF),
       tracker_period(TRACKER_PERIOD),
+      m_windowsize(FFT_SIZE),
+      m_hopsize(0),
+      m_fmin(0),
+      m_fmax(HIGH_MAX_FREQUENCY),
       m_buffersize(),
-      m_fftSize(),
-      m_buffer(new float[FFT_SIZE]),
-      m_bufferIndex(0),
-      m_input(new float[FFT_SIZE]),
+      m_adaptiveWindow(true),
+      m_windowLevels(1),
+      m_windowLevel(0),
+      m_steadyCount(0),
+      m_fftPadding(FFT_PAD_SMOOTH),
+      m_estimator(new NsdfEstimator),
+      m_estimatorSize(0),
+      m_estimatorPadding(FFT_PAD_SMOOTH),
+      m_highEstimator(),
+      m_ringbuffer(),
+      m_input(new float[2 * MAX_WINDOW_SIZE]),
+      m_inputIndex(0),
+      m_levelSum(new double[2 * MAX_WINDOW_SIZE]),
+      m_energySum(new double[2 * MAX_WINDOW_SIZE]),
+      m_levelTotal(0),
+      m_levelBase(0),
+      m_energyTotal(0),
+      m_energyBase(0),
+      m_rebaseCount(0),
       m_audioLevel(false),
-      m_fftwPlanFFT(0),
-      m_fftwPlanIFFT(0) {
-    const int size = FFT_SIZE + (FFT_SIZE+1) / 2;
-    m_fftwBufferTime = reinterpret_cast<float*>
-                       (fftwf_malloc(size * sizeof(*m_fftwBufferTime)));
-    m_fftwBufferFreq = reinterpret_cast<float*>
-                       (fftwf_malloc(size * sizeof(*m_fftwBufferFreq)));
-
-    memset(m_buffer, 0, FFT_SIZE * sizeof(*m_buffer));
-    memset(m_input, 0, FFT_SIZE * sizeof(*m_input));
-    memset(m_fftwBufferTime, 0, size * sizeof(*m_fftwBufferTime));
-    memset(m_fftwBufferFreq, 0, size * sizeof(*m_fftwBufferFreq));
-
-    sem_init(&m_trig, 0, 0);
-
-    if (!m_buffer || !m_input || !m_fftwBufferTime || !m_fftwBufferFreq) {
+      m_onsetDetection(true),
+      m_onsetBlockSize(1),
+      m_onsetCount(0),
+      m_onsetEnergy(0),
+      m_onsetLevel(0),
+      m_onsetRawLevel(0),
+      m_onsetEnvelope(0),
+      m_onsetDecay(0),
+      m_onset(false),
+      m_onsetHold(0),
+      m_nextHop(1),
+      m_gateOpen(false),
+      m_gateHold(1),
+      m_gateCount(0),
+      m_idleMode(true),
+      m_silent(true),
+      m_wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      m_sleeping(false),
+      m_newFreq(0),
+      m_newFreqArg(0) {
+    clear_window();
+    memset(m_filterBuffer, 0, m_filterBufferSize * sizeof(*m_filterBuffer));
+
+    m_ringbuffer.set_size(RINGBUFFER_SIZE);
+    m_highHistory.set_size(HIGH_HISTORY_SIZE);
+
+    if (!m_input || !m_levelSum || !m_energySum || !m_highWindow || !m_highEnergy ||
+        m_wakeFd < 0) {
         error = true;
     }
 }
@@ -140,12 +375,16 @@ PitchTracker::PitchTracker()
 
 PitchTracker::~PitchTracker() {
     stop_thread();
-    fftwf_destroy_plan(m_fftwPlanFFT);
-    fftwf_destroy_plan(m_fftwPlanIFFT);
-    fftwf_free(m_fftwBufferTime);
-    fftwf_free(m_fftwBufferFreq);
+    delete m_estimator;
     delete[] m_input;
-    delete[] m_buffer;
+    delete[] m_levelSum;
+    delete[] m_energySum;
+    delete[] m_filterBuffer;
+    delete[] m_highWindow;
+    delete[] m_highEnergy;
+    if (m_wakeFd >= 0) {
+        close(m_wakeFd);
+    }
 }
 
 void PitchTracker::set_threshold(float v) {
@@ -170,52 +409,153 @@ void PitchTracker::set_fast_note_detection(bool v) {
     }
 }
 
+bool PitchTracker::set_estimator(const std::string& name) {
+    PitchEstimator *e = PitchEstimator::create(name);
+    if (!e) {
+        return false;
+    }
+    delete m_estimator;
+    m_estimator = e;
+    m_estimatorSize = 0;
+    return true;
+}
+
+const char *PitchTracker::get_estimator() {
+    return m_estimator->name();
+}
+
+void PitchTracker::set_window_size(int v) {
+    m_windowsize = min(MAX_WINDOW_SIZE, max(MIN_WINDOW_SIZE, v));
+}
+
+void PitchTracker::set_hop_size(int v) {
+    m_hopsize = min(RINGBUFFER_SIZE / 2, max(0, v));
+    m_nextHop.store(get_hop_size(), std::memory_order_relaxed);
+}
+
+int PitchTracker::get_hop_size() {
+    int hop = m_hopsize;
+    if (hop > 0) {
+        return hop;
+    }
+    return max(1, static_cast<int>(m_sampleRate * tracker_period));
+}
+
+int PitchTracker::get_hop_frames() {
+    if (!m_sampleRate) {
+        return 0;
+    }
+    return static_cast<int>(static_cast<double>(get_hop_size()) * m_inputRate / m_sampleRate);
+}
+
+void PitchTracker::set_frequency_range(float fmin, float fmax) {
+    if (fmax <= 0 || fmax > HIGH_MAX_FREQUENCY) {
+        fmax = HIGH_MAX_FREQUENCY;
+    }
+    m_fmin = min(max(0.0f, fmin), fmax);
+    m_fmax = fmax;
+}
+
+
 bool PitchTracker::setParameters(int sampleRate, int buffersize, pthread_t j_thread) {
-    assert(buffersize <= FFT_SIZE);
+    assert(buffersize <= MAX_WINDOW_SIZE);
 
     if (error) {
         return false;
     }
-    m_sampleRate = fixed_sampleRate / DOWNSAMPLE;
-    resamp.setup(sampleRate, m_sampleRate, 1, 16); // 16 == least quality
+    // analyse at sampleRate / 2^k when that is close to the nominal
+    // rate, a resampler is only needed for the odd rates. The native
+    // mode decimates by an integer factor instead and takes the rate
+    // which comes out of it.
+    int factor = m_nativeRate ?
+                 m_decimator.setup_native(sampleRate, fixed_sampleRate / DOWNSAMPLE) :
+                 m_decimator.setup(sampleRate, fixed_sampleRate / DOWNSAMPLE);
+    m_decimate = (factor > 0);
+    if (m_decimate) {
+        m_sampleRate = sampleRate / factor;
+    } else {
+        m_sampleRate = fixed_sampleRate / DOWNSAMPLE;
+        resamp.setup(sampleRate, m_sampleRate, 1, 16); // 16 == least quality
+    }
     jack_thread = j_thread;
 
-    if (m_buffersize != buffersize) {
+    // the shorter windows, none below MIN_WINDOW_SIZE
+    int levels = 1;
+    while (m_adaptiveWindow && levels < WINDOW_LEVELS &&
+           (buffersize >> levels) >= MIN_WINDOW_SIZE) {
+        levels++;
+    }
+    if (m_buffersize != buffersize || m_windowLevels != levels) {
         m_buffersize = buffersize;
-        m_fftSize = m_buffersize + (m_buffersize+1) / 2;
-        fftwf_destroy_plan(m_fftwPlanFFT);
-        fftwf_destroy_plan(m_fftwPlanIFFT);
-        m_fftwPlanFFT = fftwf_plan_r2r_1d(
-                            m_fftSize, m_fftwBufferTime, m_fftwBufferFreq,
-                            FFTW_R2HC, FFTW_ESTIMATE);
-        m_fftwPlanIFFT = fftwf_plan_r2r_1d(
-                             m_fftSize, m_fftwBufferFreq, m_fftwBufferTime,
-                             FFTW_HC2R, FFTW_ESTIMATE);
-    }
-
-    if (!m_fftwPlanFFT || !m_fftwPlanIFFT) {
+        m_windowLevels = levels;
+        m_windowLevel = 0;
+        m_steadyCount = 0;
+        m_estimatorSize = 0;
+        clear_window();
+    }
+    // plans and buffers of the estimator for every window level
+    if (m_estimatorSize != m_buffersize || m_estimatorPadding != m_fftPadding) {
+        int sizes[WINDOW_LEVELS];
+        for (int i = 0; i < m_windowLevels; i++) {
+            sizes[i] = m_buffersize >> i;
+        }
+        if (!m_estimator->setup(sizes, m_windowLevels, m_fftPadding)) {
+            error = true;
+            return false;
+        }
+        m_estimatorSize = m_buffersize;
+        m_estimatorPadding = m_fftPadding;
+    }
+    m_highWindowSize = min(HIGH_MAX_WINDOW, static_cast<int>(sampleRate * HIGH_WINDOW_TIME));
+    if (!m_highEstimator.setup(&m_highWindowSize, 1, m_fftPadding)) {
         error = true;
         return false;
     }
 
-    if (!m_pthr) {
+    if (!m_pthr && m_threaded) {
         start_thread();
     }
     low_high_cut.init(sampleRate);
+    m_inputRate = sampleRate;
+    m_onsetBlockSize = max(1, static_cast<int>(sampleRate * ONSET_BLOCK_TIME));
+    m_onsetDecay = exp(-ONSET_BLOCK_TIME / ONSET_RELEASE);
+    m_onsetCount = 0;
+    m_onsetEnergy = m_onsetEnvelope = 0;
+    m_onsetLevel = m_onsetRawLevel = 0;
+    // the gate closes when the whole analysis window is below the
+    // threshold
+    m_gateHold = static_cast<int>(static_cast<double>(m_buffersize) * sampleRate / m_sampleRate);
+    m_gateCount = 0;
+    m_onsetHold = 0;
+    m_nextHop.store(get_hop_size(), std::memory_order_relaxed);
+    m_inputDelay = low_high_cut.delay() +
+                   (m_decimate ? m_decimator.delay() : resamp.inpsize() / 2);
     return !error;
 }
 
 void PitchTracker::stop_thread() {
+    if (!m_pthr) {
+        return;
+    }
     pthread_cancel (m_pthr);
     pthread_join (m_pthr, NULL);
+    m_pthr = 0;
 }
 
 void PitchTracker::start_thread() {
+    if (!start_rt_thread(&m_pthr, jack_thread, static_run,
+                         reinterpret_cast<void*>(this))) {
+        error = true;
+    }
+}
+
+bool PitchTracker::start_rt_thread(pthread_t *thr, pthread_t j_thread,
+                                   void *(*func)(void*), void *arg) {
     int                min = 0, max = 0;
     pthread_attr_t      attr;
     struct sched_param  spar;
     int priority, policy;
-    pthread_getschedparam(jack_thread, &policy, &spar);
+    pthread_getschedparam(j_thread, &policy, &spar);
     priority = spar.sched_priority;
     min = sched_get_priority_min(policy);
     max = sched_get_priority_max(policy);
@@ -231,228 +571,551 @@ void PitchTracker::start_thread() {
     pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
     pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
     // pthread_attr_setstacksize(&attr, 0x10000);
-    if (pthread_create(&m_pthr, &attr, static_run,
-                       reinterpret_cast<void*>(this))) {
-        error = true;
-    }
+    int r = pthread_create(thr, &attr, func, arg);
     pthread_attr_destroy(&attr);
+    return r == 0;
+}
+
+void PitchTracker::set_max_period(int frames) {
+    if (frames <= m_filterBufferSize) {
+        return;
+    }
+    float *p = new float[frames];
+    memset(p, 0, frames * sizeof(*p));
+    delete[] m_filterBuffer;
+    m_filterBuffer = p;
+    m_filterBufferSize = frames;
 }
 
 void PitchTracker::init(int samplerate, pthread_t j_thread) {
-    setParameters(samplerate, FFT_SIZE, j_thread);
+    setParameters(samplerate, m_windowsize, j_thread);
 }
 
 void PitchTracker::reset() {
-    tick = 0;
-    m_bufferIndex = 0;
     resamp.reset();
+    m_decimator.reset();
     m_freq = -1;
+    m_windowLevel = 0;
+    m_steadyCount = 0;
+    m_onsetHold = 0;
+    m_nextHop.store(get_hop_size(), std::memory_order_relaxed);
 }
 
-void PitchTracker::add(int count, float* input) {
+// called from the jack thread: pre-filter and decimate (or resample) the input into
+// the ring buffer, the tracker thread picks it up from there.
+void PitchTracker::add(int count, float* input, unsigned int frame_time) {
     if (error) {
         return;
     }
-    float output[count];
-    low_high_cut.compute(count,input,output);
-    resamp.inp_count = count;
-    resamp.inp_data = output;
-    for (;;) {
-        resamp.out_data = &m_buffer[m_bufferIndex];
-        int n = FFT_SIZE - m_bufferIndex;
-        resamp.out_count = n;
-        resamp.process();
-        n -= resamp.out_count; // n := number of output samples
-        if (!n) { // all soaked up by filter
-            return;
+    // no allocation here, the filter output goes to the preallocated
+    // scratch buffer, piece by piece when the period is longer
+    unsigned int end_time = frame_time + count;
+    bool onset = false;
+    // the unfiltered input for the high path
+    if (m_fmax > HIGH_CROSSOVER) {
+        m_highHistory.write(input, count);
+        m_highAnchor.store((static_cast<uint64_t>(end_time) << 32) |
+                           m_highHistory.write_position(), std::memory_order_release);
+    }
+    while (count > 0) {
+        int part = min(count, m_filterBufferSize);
+        low_high_cut.compute(part, input, m_filterBuffer);
+        onset |= watch_input(part, input, m_filterBuffer);
+        input += part;
+        count -= part;
+        if (m_decimate) {
+            int n = m_decimator.process(part, m_filterBuffer, m_filterBuffer);
+            if (m_ringbuffer.write(m_filterBuffer, n) < static_cast<unsigned int>(n)) {
+                return; // tracker thread is too far behind
+            }
+            continue;
+        }
+        resamp.inp_count = part;
+        resamp.inp_data = m_filterBuffer;
+        while (resamp.inp_count > 0) {
+            unsigned int n;
+            resamp.out_data = m_ringbuffer.write_ptr(&n);
+            if (!n) { // tracker thread is too far behind, drop the rest
+                return;
+            }
+            resamp.out_count = n;
+            resamp.process();
+            m_ringbuffer.write_advance(n - resamp.out_count);
         }
-        m_bufferIndex = (m_bufferIndex + n) % FFT_SIZE;
-        if (resamp.inp_count == 0) {
-            break;
+    }
+    m_anchor.store((static_cast<uint64_t>(end_time) << 32) |
+                   m_ringbuffer.write_position(), std::memory_order_release);
+    // only now, so the analysis finds the attack in the ring buffer
+    if (onset && m_onsetDetection) {
+        m_onset.store(true, std::memory_order_release);
+    }
+    // The one place the jack thread wakes anybody: a sleeping idle
+    // analysis gets one write to its eventfd when the gate opens, once
+    // per note after silence, so the attack isn't left waiting for a
+    // poll. The fence pairs with the one in arm_wakeup().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed) && !idle() &&
+        m_sleeping.exchange(false)) {
+        uint64_t one = 1;
+        ssize_t r = write(m_wakeFd, &one, sizeof(one));
+        (void)r;
+    }
+}
+
+// called from add() for blocks of the input, opens and closes the level
+// gate, and returns true when a block of the pre-filtered input is well
+// above the envelope of the blocks before it and above the threshold. A
+// note which decays never gets above its own envelope, a new one does,
+// even on the same string. The pre-filter takes out the notes of the
+// high path, the gate looks at the unfiltered input as well then.
+bool PitchTracker::watch_input(int count, const float *input, const float *filtered) {
+    bool onset = false;
+    bool high = (m_fmax > HIGH_CROSSOVER);
+    double threshold = signal_threshold_on * signal_threshold_on;
+    for (int i = 0; i < count; i++) {
+        m_onsetEnergy += filtered[i] * filtered[i];
+        m_onsetLevel += fabs(filtered[i]);
+        if (high) {
+            m_onsetRawLevel += fabs(input[i]);
         }
+        if (++m_onsetCount < m_onsetBlockSize) {
+            continue;
+        }
+        double e = m_onsetEnergy / m_onsetBlockSize;
+        if (e > threshold && e > ONSET_RATIO * m_onsetEnvelope) {
+            onset = true;
+        }
+        m_onsetEnvelope = max(e, m_onsetEnvelope * m_onsetDecay);
+        double level = max(m_onsetLevel, m_onsetRawLevel) / m_onsetBlockSize;
+        if (level >= signal_threshold_on) {
+            m_gateOpen.store(true, std::memory_order_relaxed);
+            m_gateCount = 0;
+        } else if (level >= signal_threshold_off) {
+            m_gateCount = 0;
+        } else if (m_gateCount < m_gateHold) {
+            m_gateCount += m_onsetBlockSize;
+        } else {
+            m_gateOpen.store(false, std::memory_order_relaxed);
+        }
+        m_onsetEnergy = m_onsetLevel = m_onsetRawLevel = 0;
+        m_onsetCount = 0;
     }
-    if (++tick * count >= m_sampleRate * DOWNSAMPLE * tracker_period) {
-        if (busy) {
+    return onset;
+}
+
+// jack frame time at the current read position of the ring buffer
+unsigned int PitchTracker::window_frame_time() {
+    uint64_t anchor = m_anchor.load(std::memory_order_acquire);
+    unsigned int frame = static_cast<unsigned int>(anchor >> 32);
+    // may be < 0 when add() has written but not yet moved the anchor
+    int behind = static_cast<int>(static_cast<unsigned int>(anchor) -
+                                  m_ringbuffer.read_position());
+    int frames = static_cast<int>(static_cast<double>(behind) * m_inputRate / m_sampleRate);
+    return frame - frames - m_inputDelay;
+}
+
+// seqlock writer, there is only one analysis running per tracker
+void PitchTracker::publish(float freq, float clarity, float rms, unsigned int frame) {
+    unsigned int seq = m_resultSeq.load(std::memory_order_relaxed);
+    m_resultSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_resultFreq.store(freq, std::memory_order_relaxed);
+    m_resultClarity.store(clarity, std::memory_order_relaxed);
+    m_resultRms.store(rms, std::memory_order_relaxed);
+    m_resultFrame.store(frame, std::memory_order_relaxed);
+    m_resultSeq.store(seq + 2, std::memory_order_release);
+}
+
+void PitchTracker::get_result(PitchResult *r) const {
+    for (;;) {
+        unsigned int seq = m_resultSeq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        r->freq = m_resultFreq.load(std::memory_order_relaxed);
+        r->clarity = m_resultClarity.load(std::memory_order_relaxed);
+        r->rms = m_resultRms.load(std::memory_order_relaxed);
+        r->frame_time = m_resultFrame.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_resultSeq.load(std::memory_order_relaxed) == seq) {
+            r->seq = seq / 2;
             return;
         }
-        busy = true;
-        tick = 0;
-        copy();
-        sem_post(&m_trig);
     }
 }
 
-void PitchTracker::copy() {
-    int start = (FFT_SIZE + m_bufferIndex - m_buffersize) % FFT_SIZE;
-    int end = (FFT_SIZE + m_bufferIndex) % FFT_SIZE;
-    int cnt = 0;
-    if (start >= end) {
-        cnt = FFT_SIZE - start;
-        memcpy(m_input, &m_buffer[start], cnt * sizeof(*m_input));
-        start = 0;
+// the writer may be preempted between its two stores of the seq, a
+// realtime reader must not spin until it runs again
+bool PitchTracker::try_get_result(PitchResult *r, int tries) const {
+    for (int i = 0; i < tries; i++) {
+        unsigned int seq = m_resultSeq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        PitchResult t;
+        t.freq = m_resultFreq.load(std::memory_order_relaxed);
+        t.clarity = m_resultClarity.load(std::memory_order_relaxed);
+        t.rms = m_resultRms.load(std::memory_order_relaxed);
+        t.frame_time = m_resultFrame.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_resultSeq.load(std::memory_order_relaxed) == seq) {
+            t.seq = seq / 2;
+            *r = t;
+            return true;
+        }
     }
-    memcpy(&m_input[cnt], &m_buffer[start], (end - start) * sizeof(*m_input));
+    return false;
 }
 
-inline float sq(float x) {
-    return x * x;
+float PitchTracker::get_estimated_freq() {
+    return m_resultFreq.load(std::memory_order_relaxed);
 }
 
-inline void parabolaTurningPoint(float y_1, float y0, float y1, float xOffset, float *x) {
-    float yTop = y_1 - y1;
-    float yBottom = y1 + y_1 - 2 * y0;
-    if (yBottom != 0.0) {
-        *x = xOffset + yTop / (2 * yBottom);
-    } else {
-        *x = xOffset;
+// samples the next analysis waits for: any after an onset, else the
+// hop the last analysis has chosen
+int PitchTracker::pending_hop() {
+    if (m_onset.load(std::memory_order_acquire)) {
+        return 1;
     }
+    return m_nextHop.load(std::memory_order_relaxed);
 }
 
-static int findMaxima(float *input, int len, int *maxPositions, int *length, int maxLen) {
-    int pos = 0;
-    int curMaxPos = 0;
-    int overallMaxIndex = 0;
+// hop for the next analysis: short for a while after an onset, longer
+// while the note sustains or the input is silent, as add() will report
+// the next onset anyway
+int PitchTracker::next_hop() {
+    int hop = get_hop_size();
+    if (!m_onsetDetection) {
+        return hop;
+    }
+    if (m_onsetHold > 0) {
+        return max(1, hop / ONSET_HOP_DIVISOR);
+    }
+    if (!m_audioLevel) {
+        return min(RINGBUFFER_SIZE / 2, hop * SILENCE_HOP_FACTOR);
+    }
+    if (m_steadyCount >= WINDOW_STEADY) {
+        return min(RINGBUFFER_SIZE / 2, hop * SUSTAIN_HOP_FACTOR);
+    }
+    return hop;
+}
 
-    while (pos < (len-1)/3 && input[pos] > 0.0) {
-        pos += 1;  // find the first negitive zero crossing
+bool PitchTracker::idle() {
+    return m_idleMode && !m_gateOpen.load(std::memory_order_relaxed) &&
+           m_silent.load(std::memory_order_relaxed) &&
+           !m_onset.load(std::memory_order_relaxed);
+}
+
+bool PitchTracker::arm_wakeup() {
+    m_sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!idle()) {
+        m_sleeping.store(false, std::memory_order_relaxed);
+        return false;
     }
-    while (pos < len-1 && input[pos] <= 0.0) {
-        pos += 1;  // loop over all the values below zero
+    return true;
+}
+
+void PitchTracker::disarm_wakeup() {
+    m_sleeping.store(false, std::memory_order_relaxed);
+    uint64_t n;
+    ssize_t r = read(m_wakeFd, &n, sizeof(n));
+    (void)r;
+}
+
+// nobody reads the ring buffer while idle, the analysis after it
+// wants the last window only, which holds the attack
+void PitchTracker::drop_stale() {
+    int avail = static_cast<int>(m_ringbuffer.read_space());
+    if (avail > m_buffersize) {
+        m_ringbuffer.skip(avail - m_buffersize);
     }
-    if (pos == 0) {
-        pos = 1;  // can happen if output[0] is NAN
+}
+
+bool PitchTracker::caught_up() {
+    return idle() || time_to_ready() > 0.0;
+}
+
+double PitchTracker::time_to_ready() {
+    int missing = pending_hop() - static_cast<int>(m_ringbuffer.read_space());
+    if (missing <= 0 || !m_sampleRate) {
+        return 0.0;
     }
-    while (pos < len-1) {
-        if (input[pos] > input[pos-1] && input[pos] >= input[pos+1]) {  // a local maxima
-            if (curMaxPos == 0) {
-                curMaxPos = pos;  // the first maxima (between zero crossings)
-            } else if (input[pos] > input[curMaxPos]) {
-                curMaxPos = pos;  // a higher maxima (between the zero crossings)
+    return static_cast<double>(missing) / m_sampleRate;
+}
+
+// sleep until the next hop is in the ring buffer, but wake up every
+// ONSET_POLL seconds to see whether add() has found an onset. While
+// idle sleep until add() opens the gate, or IDLE_WAIT seconds for
+// analyse() to drop the stale samples.
+void PitchTracker::wait_for_samples() {
+    for (;;) {
+        if (idle()) {
+            if (arm_wakeup()) {
+                struct pollfd p;
+                p.fd = m_wakeFd;
+                p.events = POLLIN;
+                poll(&p, 1, static_cast<int>(IDLE_WAIT * 1000));
+                disarm_wakeup();
             }
+            return;
         }
-        pos += 1;
-        if (pos < len-1 && input[pos] <= 0.0) {  // a negative zero crossing
-            if (curMaxPos > 0) {  // if there was a maximum
-                maxPositions[*length] = curMaxPos;  // add it to the vector of maxima
-                *length += 1;
-                if (overallMaxIndex == 0) {
-                    overallMaxIndex = curMaxPos;
-                } else if (input[curMaxPos] > input[overallMaxIndex]) {
-                    overallMaxIndex = curMaxPos;
-                }
-                if (*length >= maxLen) {
-                    return overallMaxIndex;
-                }
-                curMaxPos = 0;  // clear the maximum position, so we start looking for a new ones
-            }
-            while (pos < len-1 && input[pos] <= 0.0) {
-                pos += 1;  // loop over all the values below zero
-            }
+        double t = time_to_ready();
+        if (t <= 0.0) {
+            return;
         }
-    }
-    if (curMaxPos > 0) {  // if there was a maximum in the last part
-        maxPositions[*length] = curMaxPos;  // add it to the vector of maxima
-        *length += 1;
-        if (overallMaxIndex == 0) {
-            overallMaxIndex = curMaxPos;
-        } else if (input[curMaxPos] > input[overallMaxIndex]) {
-            overallMaxIndex = curMaxPos;
+        t = max(0.0005, t);
+        if (m_onsetDetection) {
+            t = min(ONSET_POLL, t);
         }
-        curMaxPos = 0;  // clear the maximum position, so we start looking for a new ones
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(t);
+        ts.tv_nsec = static_cast<long>((t - ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
     }
-    return overallMaxIndex;
 }
 
-static int findsubMaximum(float *input, int len, float threshold) {
-    int indices[10];
-    int length = 0;
-    int overallMaxIndex = findMaxima(input, len, indices, &length, 10);
-    if (length == 0) {
-        return -1;
-    }
-    threshold += (1.0 - threshold) * (1.0 - input[overallMaxIndex]);
-    float cutoff = input[overallMaxIndex] * threshold;
-    for (int j = 0; j < length; j++) {
-        if (input[indices[j]] >= cutoff) {
-            return indices[j];
+void PitchTracker::clear_window() {
+    memset(m_input, 0, 2 * MAX_WINDOW_SIZE * sizeof(*m_input));
+    memset(m_levelSum, 0, 2 * MAX_WINDOW_SIZE * sizeof(*m_levelSum));
+    memset(m_energySum, 0, 2 * MAX_WINDOW_SIZE * sizeof(*m_energySum));
+    m_inputIndex = 0;
+    m_levelTotal = m_levelBase = 0;
+    m_energyTotal = m_energyBase = 0;
+    m_rebaseCount = 0;
+}
+
+// append count samples to the analysis window, the running sums are
+// updated per sample, so the cost is O(count) and not O(window).
+void PitchTracker::push_window(const float *input, int count) {
+    for (int i = 0; i < count; i++) {
+        int k = m_inputIndex;
+        double x = input[i];
+        // the sample which drops out of the window
+        m_levelBase = m_levelSum[k];
+        m_energyBase = m_energySum[k];
+        m_levelTotal += fabs(x);
+        m_energyTotal += x * x;
+        m_input[k] = m_input[k + m_buffersize] = input[i];
+        m_levelSum[k] = m_levelSum[k + m_buffersize] = m_levelTotal;
+        m_energySum[k] = m_energySum[k + m_buffersize] = m_energyTotal;
+        if (++m_inputIndex == m_buffersize) {
+            m_inputIndex = 0;
         }
     }
-    // should never get here
-    return -1;
+    m_rebaseCount += count;
+    if (m_rebaseCount >= REBASE_PERIOD) {
+        rebase_window();
+    }
+}
+
+// the running sums grow without bound, subtract the part in front of
+// the window now and then before it eats up the double precision.
+void PitchTracker::rebase_window() {
+    for (int k = 0; k < 2 * m_buffersize; k++) {
+        m_levelSum[k] -= m_levelBase;
+        m_energySum[k] -= m_energyBase;
+    }
+    m_levelTotal -= m_levelBase;
+    m_energyTotal -= m_energyBase;
+    m_levelBase = m_energyBase = 0;
+    m_rebaseCount = 0;
 }
 
 void PitchTracker::run() {
     for (;;) {
-        busy = false;
-        sem_wait(&m_trig);
-        if (error) {
-            continue;
-        }
-        float sum = 0.0;
-        for (int k = 0; k < m_buffersize; ++k) {
-            sum += fabs(m_input[k]);
+        wait_for_samples();
+        pthread_testcancel();
+        analyse();
+    }
+}
+
+bool PitchTracker::analyse() {
+    if (idle()) {
+        drop_stale();
+        return false;
+    }
+    // windows overlap when the hop is smaller than the window
+    int avail = static_cast<int>(m_ringbuffer.read_space());
+    int hop = pending_hop();
+    if (avail < hop) {
+        return false;
+    }
+    // a new note: analyse up to the attack right now, on the full
+    // window, as the note may be lower than the one before
+    if (m_onset.exchange(false, std::memory_order_acquire)) {
+        hop = avail;
+        m_onsetHold = static_cast<int>(m_sampleRate * ONSET_HOLD) + hop;
+        m_windowLevel = 0;
+        m_steadyCount = 0;
+    }
+    m_onsetHold = max(0, m_onsetHold - hop);
+    if (hop > m_buffersize) {
+        m_ringbuffer.skip(hop - m_buffersize);
+        hop = m_buffersize;
+    }
+    while (hop > 0) {
+        float chunk[256];
+        int n = m_ringbuffer.read(chunk, min(hop, 256));
+        push_window(chunk, n);
+        hop -= n;
+    }
+    if (error) {
+        return true;
+    }
+    double fullEnergy = m_energyTotal - m_energyBase;
+    float rms = sqrt(max(0.0, fullEnergy) / m_buffersize);
+    float threshold = (m_audioLevel ? signal_threshold_off : signal_threshold_on);
+    m_audioLevel = ((m_levelTotal - m_levelBase) / m_buffersize >= threshold);
+    if ( m_audioLevel == false ) {
+        m_windowLevel = 0;
+        m_steadyCount = 0;
+    }
+    float clarity = 0.0;
+    float x = m_audioLevel ? estimate_low(&clarity) : 0.0;
+    unsigned int frame = window_frame_time();
+    // the low path loses precision towards MAX_FREQUENCY and misses the
+    // notes above it, the pre-filter even takes them out of the level,
+    // so the high path has a go when it finds nothing or a high note,
+    // as long as the gate of add() (which sees the unfiltered input)
+    // is open. What's left of a high note after the pre-filter can also
+    // look like a subharmonic of it: only when most of the energy of
+    // the unfiltered window is above the pre-filter, the high path runs
+    // on a lower estimate as well and wins when it is a multiple of it.
+    if (m_fmax > HIGH_CROSSOVER &&
+        (m_audioLevel || m_gateOpen.load(std::memory_order_relaxed))) {
+        bool subharmonic = (x > HIGH_ENGAGE / 4 && x <= HIGH_ENGAGE);
+        float r;
+        unsigned int f;
+        if ((x == 0.0 || x > HIGH_ENGAGE || subharmonic) && read_high(&r, &f) &&
+            (!subharmonic || r > HIGH_LEVEL_RATIO * rms)) {
+            float c;
+            float y = estimate_high(&c);
+            float n = subharmonic ? roundf(y / x) : 0.0;
+            if (y >= HIGH_CROSSOVER &&
+                (!subharmonic || (n >= 2 && fabs(y - n * x) < 0.03 * y))) {
+                x = y;
+                clarity = c;
+                frame = f;
+            }
         }
-        float threshold = (m_audioLevel ? signal_threshold_off : signal_threshold_on);
-        m_audioLevel = (sum / m_buffersize >= threshold);
-        if ( m_audioLevel == false ) {
-	    if (m_freq != 0) {
-		m_freq = 0;
-		//new_freq();
-	    }
-            continue;
+    }
+    publish(x, clarity, rms, frame);
+    if (m_audioLevel) {
+        adapt_window(x, clarity);
+    }
+    if (m_freq != x) {
+        m_freq = x;
+        if (m_newFreq) {
+            m_newFreq(m_newFreqArg);
         }
+    }
+    m_nextHop.store(next_hop(), std::memory_order_relaxed);
+    m_silent.store(!m_audioLevel && x == 0.0, std::memory_order_relaxed);
+    return true;
+}
 
-        memcpy(m_fftwBufferTime, m_input, m_buffersize * sizeof(*m_fftwBufferTime));
-        memset(m_fftwBufferTime+m_buffersize, 0, (m_fftSize - m_buffersize) * sizeof(*m_fftwBufferTime));
-        fftwf_execute(m_fftwPlanFFT);
-        for (int k = 1; k < m_fftSize/2; k++) {
-            m_fftwBufferFreq[k] = sq(m_fftwBufferFreq[k]) + sq(m_fftwBufferFreq[m_fftSize-k]);
-            m_fftwBufferFreq[m_fftSize-k] = 0.0;
-        }
-        m_fftwBufferFreq[0] = sq(m_fftwBufferFreq[0]);
-        m_fftwBufferFreq[m_fftSize/2] = sq(m_fftwBufferFreq[m_fftSize/2]);
+// the decimated path, on the newest part of the analysis window
+float PitchTracker::estimate_low(float *clarity) {
+    // the newest size samples of the window, their running sums start
+    // at energy[-1] (m_energyBase for the full window)
+    const int level = m_windowLevel;
+    const int size = m_buffersize >> level;
+    const int skip = m_buffersize - size;
+    const float *input = &m_input[m_inputIndex + skip];
+    const double *energy = &m_energySum[m_inputIndex + skip];
+    double windowEnergy = m_energyTotal - (skip ? energy[-1] : m_energyBase);
+
+    float fmin = m_fmin;
+    float fmax = min(m_fmax, MAX_FREQUENCY);
+    AnalysisWindow w = { input, size, energy, windowEnergy, m_sampleRate, fmin, fmax };
+    float x = m_estimator->estimate(w, clarity);
+    if (x > fmax || x < fmin) {
+        x = 0.0;
+        *clarity = 0.0;
+    }
+    return x;
+}
 
-        fftwf_execute(m_fftwPlanIFFT);
+// the window of the high path: the newest samples of the unfiltered
+// input at the jack rate. *frame is the jack frame time of its end,
+// *rms its level, false when it is below the threshold.
+bool PitchTracker::read_high(float *rms, unsigned int *frame) {
+    *rms = 0.0;
+    uint64_t anchor = m_highAnchor.load(std::memory_order_acquire);
+    *frame = static_cast<unsigned int>(anchor >> 32);
+    const int size = m_highWindowSize;
+    float *input = m_highWindow;
+    if (!size || !m_highHistory.read(input, size, static_cast<unsigned int>(anchor))) {
+        return false;
+    }
+    double level = 0.0;
+    double windowEnergy = 0.0;
+    for (int i = 0; i < size; i++) {
+        level += fabs(input[i]);
+        windowEnergy += input[i] * input[i];
+        m_highEnergy[i] = windowEnergy;
+    }
+    *rms = sqrt(windowEnergy / size);
+    return level / size >= signal_threshold_on;
+}
 
-        double sumSq = 2.0 * static_cast<double>(m_fftwBufferTime[0]) / static_cast<double>(m_fftSize);
-        for (int k = 0; k < m_fftSize - m_buffersize; k++) {
-            m_fftwBufferTime[k] = m_fftwBufferTime[k+1] / static_cast<float>(m_fftSize);
-        }
+// the high path on the window of read_high(), always by NSDF. Only lags
+// of notes above HIGH_ENGAGE are examined, so the direct
+// autocorrelation is cheap.
+float PitchTracker::estimate_high(float *clarity) {
+    const int size = m_highWindowSize;
+    float fmin = max(m_fmin, HIGH_ENGAGE * 0.9f);
+    float fmax = m_fmax;
+    AnalysisWindow w = { m_highWindow, size, m_highEnergy, m_highEnergy[size - 1],
+                         m_inputRate, fmin, fmax };
+    float x = m_highEstimator.estimate(w, clarity);
+    if (x > fmax || x < fmin) {
+        x = 0.0;
+        *clarity = 0.0;
+    }
+    return x;
+}
 
-        int count = (m_buffersize + 1) / 2;
-        for (int k = 0; k < count; k++) {
-            sumSq  -= sq(m_input[m_buffersize-1-k]) + sq(m_input[k]);
-            // dividing by zero is very slow, so deal with it seperately
-            if (sumSq > 0.0) {
-                m_fftwBufferTime[k] *= 2.0 / sumSq;
-            } else {
-                m_fftwBufferTime[k] = 0.0;
-            }
-        }
-	const float thres = 0.99; // was 0.6
-        int maxAutocorrIndex = findsubMaximum(m_fftwBufferTime, count, thres);
-
-        float x = 0.0;
-        if (maxAutocorrIndex >= 0) {
-            parabolaTurningPoint(m_fftwBufferTime[maxAutocorrIndex-1],
-                                 m_fftwBufferTime[maxAutocorrIndex],
-                                 m_fftwBufferTime[maxAutocorrIndex+1],
-                                 maxAutocorrIndex+1, &x);
-            x = m_sampleRate / x;
-            if (x > 1060.0) {  // precision drops above 1000 Hz
-                x = 0.0;
-            }
+// choose the window for the next hop: the shortest one which holds
+// WINDOW_PERIODS periods of the note. It shrinks only with some margin
+// and after a few steady estimates, but grows at once, and falls back
+// to the full window when there is no clear pitch.
+void PitchTracker::adapt_window(float freq, float clarity) {
+    if (freq <= 0 || clarity < WINDOW_MIN_CLARITY) {
+        m_windowLevel = 0;
+        m_steadyCount = 0;
+        return;
+    }
+    // next_hop() counts on this as well
+    if (m_freq > 0 && fabs(freq - m_freq) < 0.03 * m_freq) {
+        m_steadyCount++;
+    } else {
+        m_steadyCount = 0;
+    }
+    if (m_windowLevels < 2) {
+        return;
+    }
+    // periods of the note in the full window
+    float periods = freq * m_buffersize / m_sampleRate;
+    int level = m_windowLevel;
+    while (level > 0 && periods / (1 << level) < WINDOW_PERIODS) {
+        level--;
+    }
+    if (level == m_windowLevel && m_steadyCount >= WINDOW_STEADY) {
+        while (level + 1 < m_windowLevels &&
+               periods / (2 << level) >= WINDOW_PERIODS * WINDOW_HYSTERESIS) {
+            level++;
         }
-	if (m_freq != x) {
-	    m_freq = x;
-	    //new_freq();
-	}
+    }
+    if (level != m_windowLevel) {
+        m_windowLevel = level;
+        m_steadyCount = 0;
     }
 }
 
 float PitchTracker::get_estimated_note() {
-    return m_freq <= 0.0 ? 1000.0 : 12 * log2f(2.272727e-03f * m_freq);
+    float freq = get_estimated_freq();
+    return freq <= 0.0 ? 1000.0 : 12 * log2f(2.272727e-03f * freq);
 }
 
-PitchTracker pitch_tracker;
-
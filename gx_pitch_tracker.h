@@ -25,16 +25,25 @@
 #define GX_PITCH_TRACKER_H_
 
 #include <fftw3.h>
-#include <semaphore.h>
 #include <assert.h> 
 #include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
 //#include <glibmm.h>
 
+#include <stdint.h>
+
+#include <atomic>
 #include <cstring> 
 #include <cmath>
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 #include "resample.h"
+#include "./gx_decimator.h"
+#include "./gx_pitch_estimator.h"
+#include "./gx_ringbuffer.h"
 
 /* ------------- Pitch Tracker ------------- */
 
@@ -53,50 +62,207 @@ private:
 	double 	fConst7;
 	double 	fConst8;
 	double 	fConst9;
+	double 	fConst10;
 	double 	fRec4[2];
 	double 	fVec1[2];
-	double 	fConst10;
 	double 	fRec3[2];
 	double 	fRec2[2];
 	double 	fRec1[3];
 	double 	fRec0[3];
+	// the same cascade as 4 biquad sections (transposed direct form II),
+	// one section per vector lane for the simd implementations
+	double 	fB0[4];
+	double 	fB1[4];
+	double 	fB2[4];
+	double 	fA1[4];
+	double 	fA2[4];
+	double 	fS1[4];
+	double 	fS2[4];
+	double 	fY[4];
+	double 	fDenormal;
+	int 	iSimd;
+	void 	compute_scalar(int count, float *input0, float *output0);
+	void 	compute_sse2(int count, float *input0, float *output0);
+	void 	compute_avx2(int count, float *input0, float *output0);
 public:
+	enum { SIMD_NONE, SIMD_SSE2, SIMD_AVX2 };
 	void clear_state_f();
-	void init(int samplingFreq);
+	// simd_max limits the instruction set picked at runtime
+	void init(int samplingFreq, int simd_max = SIMD_AVX2);
+	int  simd() { return iSimd; }
+	// output lags the input by delay() samples
+	int  delay() { return iSimd == SIMD_NONE ? 0 : 3; }
 	void compute(int count, float *input0, float *output0);
 };
 
+// one estimate of the tracker, see PitchTracker::get_result()
+struct PitchResult {
+    // detected frequency in Hz, 0 == no pitch
+    float           freq;
+    // how sure the estimator is, for the NSDF the height of the peak
+    // the frequency was taken from, 0 .. 1
+    float           clarity;
+    // rms level of the analysed window
+    float           rms;
+    // jack frame time at the end of the analysed window, as passed to add()
+    unsigned int    frame_time;
+    // number of the estimate, 0 == nothing published yet
+    unsigned int    seq;
+};
+
 class PitchTracker {
  public:
     explicit PitchTracker();
     ~PitchTracker();
     void            init(int samplerate, pthread_t j_thread);
-    void            add(int count, float *input);
-    float           get_estimated_freq() { return m_freq < 0 ? 0 : m_freq; }
+    // frame_time: jack frame time of input[0], realtime safe, periods
+    // longer than set_max_period() are processed in pieces
+    void            add(int count, float *input, unsigned int frame_time = 0);
+    // size the scratch buffer of add(), not realtime safe and must not
+    // run concurrently with add() (e.g. from the jack buffer size callback)
+    void            set_max_period(int frames);
+    // consistent snapshot of the latest estimate, lock free
+    void            get_result(PitchResult *r) const;
+    // the same for a realtime thread, gives up after tries attempts
+    // which met the analysis thread inside its update and returns false,
+    // *r is left as it was then
+    bool            try_get_result(PitchResult *r, int tries = 2) const;
+    float           get_estimated_freq();
     float           get_estimated_note();
     void            stop_thread();
     void            reset();
     void            set_threshold(float v);
     float            get_threshold();
     void            set_fast_note_detection(bool v);
-    //Glib::Dispatcher new_freq;
+    // analysis window in samples, takes effect on init()
+    void            set_window_size(int v);
+    // analyse high notes with a half or a quarter of the window,
+    // takes effect on init()
+    void            set_adaptive_window(bool v) { m_adaptiveWindow = v; }
+    int             get_window_size() { return m_windowsize; }
+    // analyse at once when add() sees the attack of a note, in short
+    // hops for a while after it and in longer ones while a note
+    // sustains or the input is silent, takes effect on init()
+    void            set_onset_detection(bool v) { m_onsetDetection = v; }
+    // false == add() keeps feeding the analysis while the input is
+    // below the threshold and idle() is never true, for an estimate on
+    // every hop (the offline analysis)
+    void            set_idle_mode(bool v) { m_idleMode = v; }
+    // samples between two estimates, 0 == derive from tracker_period
+    void            set_hop_size(int v);
+    int             get_hop_size();
+    // the same in frames of the input, after init()
+    int             get_hop_frames();
+    // only look for pitches between fmin and fmax (Hz), 0 == no limit
+    void            set_frequency_range(float fmin, float fmax);
+    // zero padding of the autocorrelation fft, takes effect on init()
+    enum {
+        FFT_PAD_MIN = PitchEstimator::FFT_PAD_MIN,
+        FFT_PAD_SMOOTH = PitchEstimator::FFT_PAD_SMOOTH,
+        FFT_PAD_POW2 = PitchEstimator::FFT_PAD_POW2
+    };
+    void            set_fft_padding(int v) { m_fftPadding = v; }
+    static int      fft_size(int buffersize, int padding) {
+        return PitchEstimator::fft_size(buffersize, padding);
+    }
+    // pitch estimator of the decimated path by name (see
+    // PitchEstimator::create()), false for an unknown one. Not realtime
+    // safe and must not run concurrently with analyse(), takes effect
+    // on init()
+    bool            set_estimator(const std::string& name);
+    const char     *get_estimator();
+    // analyse at an integer fraction of the jack rate instead of the
+    // nominal rate, never resamples, takes effect on init()
+    void            set_native_rate(bool v) { m_nativeRate = v; }
+    // false == no own analysis thread, a TrackerPool calls analyse()
+    void            set_threaded(bool v) { m_threaded = v; }
+    // run one analysis step if a full hop is buffered, never blocks
+    bool            analyse();
+    // seconds until the next hop is complete, 0 == ready now
+    double          time_to_ready();
+    // true while the input stays below the threshold and the last
+    // estimate was "no pitch", nothing to analyse until add() opens the
+    // gate again. analyse() then only drops what is older than a
+    // window.
+    bool            idle();
+    // An idle analysis may sleep on wakeup_fd() (an eventfd) once
+    // arm_wakeup() has returned true, add() writes it when the gate
+    // opens and disarm_wakeup() afterwards clears it. false == not idle
+    // any more, don't sleep.
+    int             wakeup_fd() { return m_wakeFd; }
+    bool            arm_wakeup();
+    void            disarm_wakeup();
+    // true when less than a hop is left to analyse or the tracker is
+    // idle, for a source which must not quit before its end is analysed
+    bool            caught_up();
+    // called from the analysis thread whenever the estimate changes,
+    // before init()
+    void            set_new_freq(void (*callback)(void *arg), void *arg) {
+        m_newFreq = callback;
+        m_newFreqArg = arg;
+    }
+    // start a thread at the priority of the analysis threads
+    static bool     start_rt_thread(pthread_t *thr, pthread_t j_thread,
+                                    void *(*func)(void*), void *arg);
  private:
     Dsp             low_high_cut;
     bool            setParameters(int sampleRate, int buffersize, pthread_t j_thread);
     void            run();
     static void     *static_run(void* p);
     void            start_thread();
-    void            copy();
+    void            wait_for_samples();
+    void            drop_stale();
+    bool            watch_input(int count, const float *input, const float *filtered);
+    int             pending_hop();
+    int             next_hop();
+    void            clear_window();
+    void            push_window(const float *input, int count);
+    void            rebase_window();
+    void            adapt_window(float freq, float clarity);
+    unsigned int    window_frame_time();
+    void            publish(float freq, float clarity, float rms, unsigned int frame);
+    float           estimate_low(float *clarity);
+    bool            read_high(float *rms, unsigned int *frame);
+    float           estimate_high(float *clarity);
     bool            error;
-    volatile bool   busy;
-    int             tick;
-    sem_t           m_trig;
     pthread_t       m_pthr;
+    // whether init() starts m_pthr
+    bool            m_threaded;
     pthread_t       jack_thread;
     Resampler       resamp;
+    // used instead of resamp when the jack rate allows it
+    Decimator       m_decimator;
+    bool            m_decimate;
+    // decimate by an integer factor even when it misses the nominal rate
+    bool            m_nativeRate;
     int             m_sampleRate;
     int             fixed_sampleRate;
+    // last frequency estimate, only used by the analysis
     float           m_freq;
+    // latest result, written under the seqlock m_resultSeq (odd while
+    // an update is in progress)
+    std::atomic<unsigned int> m_resultSeq;
+    std::atomic<float> m_resultFreq;
+    std::atomic<float> m_resultClarity;
+    std::atomic<float> m_resultRms;
+    std::atomic<unsigned int> m_resultFrame;
+    // frame time (high word) for a ring buffer write position (low
+    // word), set by add() to map analysed samples back to jack frames
+    std::atomic<uint64_t> m_anchor;
+    // unfiltered input at the jack rate for the high path, and the
+    // frame time (high word) for a write position (low word) of it
+    HistoryBuffer   m_highHistory;
+    std::atomic<uint64_t> m_highAnchor;
+    // the newest m_highWindowSize samples and their running energy
+    float          *m_highWindow;
+    double         *m_highEnergy;
+    int             m_highWindowSize;
+    // output of the pre-filter for one call of add()
+    float          *m_filterBuffer;
+    int             m_filterBufferSize;
+    // input samples the pre-filter and the resampler lag behind
+    int             m_inputDelay;
+    int             m_inputRate;
     // Value of the threshold above which
     // the processing is activated.
     float           signal_threshold_on;
@@ -105,28 +271,86 @@ class PitchTracker {
     float           signal_threshold_off;
     // Time between frequency estimates (in seconds)
     float           tracker_period;
+    // requested analysis window size
+    int             m_windowsize;
+    // number of new samples between two analysis windows
+    volatile int    m_hopsize;
+    // frequency range of interest
+    volatile float  m_fmin;
+    volatile float  m_fmax;
     // number of samples in input buffer
     int             m_buffersize;
-    // Size of the FFT window.
-    int             m_fftSize;
-    // The audio buffer that stores the input signal.
-    float           *m_buffer;
-    // Index of the first empty position in the buffer.
-    int             m_bufferIndex;
-    // buffer for input signal
+    // the analysis runs on the newest m_buffersize >> level samples,
+    // level 0 for low notes, up to m_windowLevels-1 for high ones
+    enum { WINDOW_LEVELS = 3 };
+    bool            m_adaptiveWindow;
+    int             m_windowLevels;
+    int             m_windowLevel;
+    // estimates in a row close to the one before
+    int             m_steadyCount;
+    // how the fft sizes are rounded up
+    int             m_fftPadding;
+    // the pitch estimator of the decimated path, set up for the
+    // windows of m_estimatorSize with m_estimatorPadding
+    PitchEstimator *m_estimator;
+    int             m_estimatorSize;
+    int             m_estimatorPadding;
+    // the high path always uses the NSDF
+    NsdfEstimator   m_highEstimator;
+    // Resampled input signal, filled by the jack thread
+    // and drained by the tracker thread.
+    RingBuffer      m_ringbuffer;
+    // analysis window, stored twice in a row so that the last
+    // m_buffersize samples always start contiguous at m_inputIndex.
     float           *m_input;
+    // Index of the oldest sample in the analysis window.
+    int             m_inputIndex;
+    // Running sums of |x| and x*x over all samples seen so far, stored
+    // like m_input, so level and energy of the window (or of any part
+    // of it) are a difference of two entries.
+    double          *m_levelSum;
+    double          *m_energySum;
+    // running sums up to the newest and before the oldest sample
+    double          m_levelTotal;
+    double          m_levelBase;
+    double          m_energyTotal;
+    double          m_energyBase;
+    // samples since the running sums were last rebased
+    int             m_rebaseCount;
     // Whether or not the input level is high enough.
     bool            m_audioLevel;
-    // Support buffer used to store signals in the time domain.
-    float          *m_fftwBufferTime;
-    // Support buffer used to store signals in the frequency domain.
-    float          *m_fftwBufferFreq;
-    // Plan to compute the FFT of a given signal.
-    fftwf_plan      m_fftwPlanFFT;
-    // Plan to compute the IFFT of a given signal (with additional zero-padding).
-    fftwf_plan      m_fftwPlanIFFT;
+    // onset detection of add(): energy of blocks of m_onsetBlockSize
+    // pre-filtered samples against a peak envelope which falls by
+    // m_onsetDecay per block
+    bool            m_onsetDetection;
+    int             m_onsetBlockSize;
+    int             m_onsetCount;
+    double          m_onsetEnergy;
+    double          m_onsetLevel;
+    double          m_onsetRawLevel;
+    double          m_onsetEnvelope;
+    double          m_onsetDecay;
+    // set by add() on the attack of a note, cleared by the analysis
+    std::atomic<bool> m_onset;
+    // samples to analyse in short hops after an onset
+    int             m_onsetHold;
+    // samples the next analysis waits for, chosen by the one before
+    std::atomic<int> m_nextHop;
+    // level gate of add(): open while a block of the last
+    // m_gateHold input samples reached the threshold, m_gateCount
+    // samples since the last one did
+    std::atomic<bool> m_gateOpen;
+    int             m_gateHold;
+    int             m_gateCount;
+    // whether the analysis may sleep while the gate is closed
+    bool            m_idleMode;
+    // set by the analysis when it found no level and no pitch
+    std::atomic<bool> m_silent;
+    // eventfd add() writes when the gate opens while m_sleeping
+    int             m_wakeFd;
+    std::atomic<bool> m_sleeping;
+    void            (*m_newFreq)(void *arg);
+    void           *m_newFreqArg;
 };
 
-extern PitchTracker pitch_tracker;
-
 #endif  // SRC_HEADERS_GX_PITCH_TRACKER_H_
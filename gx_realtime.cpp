@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_realtime.cpp      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "./gx_realtime.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// stack reserved for the process callback
+static const int PREFAULT_STACK_SIZE = 128 * 1024;
+
+#ifdef GX_RT_DEBUG
+// bottom of the prefaulted stack, filled with CANARY
+static const int CANARY_SIZE = 256;
+static const unsigned char CANARY = 0xa5;
+static __thread uintptr_t rt_canary = 0;
+static __thread bool rt_active = false;
+
+static void rt_trap(const char *msg) {
+    // no stdio here, it may allocate
+    rt_active = false;
+    if (write(2, msg, strlen(msg)) < 0) {
+        abort();
+    }
+    abort();
+}
+#endif
+
+// noinline, so that buf really is below the frame of the caller
+__attribute__((noinline)) void gx_rt_prefault_stack() {
+    unsigned char buf[PREFAULT_STACK_SIZE];
+    memset(buf, 0, PREFAULT_STACK_SIZE);
+#ifdef GX_RT_DEBUG
+    // the stack grows down, buf[0] is the deepest prefaulted byte
+    memset(buf, CANARY, CANARY_SIZE);
+    rt_canary = reinterpret_cast<uintptr_t>(buf);
+#endif
+    // keep the compiler from dropping the stores
+    asm volatile("" : : "r"(buf) : "memory");
+}
+
+#ifdef GX_RT_DEBUG
+void gx_rt_enter() {
+    rt_active = true;
+}
+
+void gx_rt_leave() {
+    rt_active = false;
+    if (!rt_canary) {
+        return;
+    }
+    const unsigned char *canary = reinterpret_cast<const unsigned char*>(rt_canary);
+    for (int i = 0; i < CANARY_SIZE; i++) {
+        if (canary[i] != CANARY) {
+            rt_trap("gxtuner: realtime thread grew past the prefaulted stack\n");
+        }
+    }
+}
+
+// glibc's own allocator, the traps below forward to it
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size) {
+    if (rt_active) {
+        rt_trap("gxtuner: malloc() in the realtime thread\n");
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    if (rt_active) {
+        rt_trap("gxtuner: calloc() in the realtime thread\n");
+    }
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+    if (rt_active) {
+        rt_trap("gxtuner: realloc() in the realtime thread\n");
+    }
+    return __libc_realloc(p, size);
+}
+}
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_realtime.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_REALTIME_H_
+#define GX_REALTIME_H_
+
+/* ------------- helpers for the jack process thread ------------- */
+
+// touch the stack the process callback may use, so that it doesn't
+// page fault later. Call it once from the realtime thread.
+void gx_rt_prefault_stack();
+
+// Build with -DGX_RT_DEBUG ("make rtdebug") to abort when malloc(),
+// calloc() or realloc() is called between gx_rt_enter() and
+// gx_rt_leave(), or when the realtime thread used more stack than
+// gx_rt_prefault_stack() has touched.
+#ifdef GX_RT_DEBUG
+void gx_rt_enter();
+void gx_rt_leave();
+#else
+inline void gx_rt_enter() {}
+inline void gx_rt_leave() {}
+#endif
+
+#endif  // GX_REALTIME_H_
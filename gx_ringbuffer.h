@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_ringbuffer.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_RINGBUFFER_H_
+#define GX_RINGBUFFER_H_
+
+#include <atomic>
+#include <cstring>
+
+/* ------------- lock-free single producer / single consumer ------------- */
+
+// The producer (jack process thread) only moves m_head, the consumer
+// (pitch tracker thread) only moves m_tail. Both positions count samples
+// and wrap at 2^32, the buffer size must be a power of two.
+
+#define GX_CACHELINE_SIZE 64
+
+class RingBuffer {
+ private:
+    float          *m_data;
+    unsigned int    m_size;
+    unsigned int    m_mask;
+    // write position, owned by the producer
+    alignas(GX_CACHELINE_SIZE) std::atomic<unsigned int> m_head;
+    // read position, owned by the consumer
+    alignas(GX_CACHELINE_SIZE) std::atomic<unsigned int> m_tail;
+ public:
+    explicit RingBuffer()
+        : m_data(0), m_size(0), m_mask(0), m_head(0), m_tail(0) {}
+    ~RingBuffer() { delete[] m_data; }
+    // allocate storage for at least size samples, not realtime safe and
+    // must not run concurrently with the producer or the consumer.
+    bool set_size(unsigned int size) {
+        unsigned int n = 1;
+        while (n < size) {
+            n <<= 1;
+        }
+        float *p = new float[n];
+        memset(p, 0, n * sizeof(*p));
+        delete[] m_data;
+        m_data = p;
+        m_size = n;
+        m_mask = n - 1;
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+        return true;
+    }
+    unsigned int size() const { return m_size; }
+
+    // ---- producer side
+    unsigned int write_space() const {
+        return m_size - (m_head.load(std::memory_order_relaxed) -
+                         m_tail.load(std::memory_order_acquire));
+    }
+    // contiguous free region starting at the write position
+    float *write_ptr(unsigned int *n) {
+        unsigned int head = m_head.load(std::memory_order_relaxed);
+        unsigned int idx = head & m_mask;
+        unsigned int space = write_space();
+        *n = (space < m_size - idx) ? space : m_size - idx;
+        return &m_data[idx];
+    }
+    unsigned int write_position() const {
+        return m_head.load(std::memory_order_relaxed);
+    }
+    void write_advance(unsigned int n) {
+        m_head.store(m_head.load(std::memory_order_relaxed) + n,
+                     std::memory_order_release);
+    }
+    unsigned int write(const float *src, unsigned int n) {
+        unsigned int done = 0;
+        while (done < n) {
+            unsigned int cnt;
+            float *p = write_ptr(&cnt);
+            if (!cnt) {
+                break;
+            }
+            if (cnt > n - done) {
+                cnt = n - done;
+            }
+            memcpy(p, src + done, cnt * sizeof(*p));
+            write_advance(cnt);
+            done += cnt;
+        }
+        return done;
+    }
+
+    // ---- consumer side
+    unsigned int read_space() const {
+        return m_head.load(std::memory_order_acquire) -
+               m_tail.load(std::memory_order_relaxed);
+    }
+    unsigned int read_position() const {
+        return m_tail.load(std::memory_order_relaxed);
+    }
+    unsigned int read(float *dst, unsigned int n) {
+        unsigned int avail = read_space();
+        if (n > avail) {
+            n = avail;
+        }
+        unsigned int tail = m_tail.load(std::memory_order_relaxed);
+        unsigned int idx = tail & m_mask;
+        unsigned int cnt = (n < m_size - idx) ? n : m_size - idx;
+        memcpy(dst, &m_data[idx], cnt * sizeof(*dst));
+        memcpy(dst + cnt, m_data, (n - cnt) * sizeof(*dst));
+        m_tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+    unsigned int skip(unsigned int n) {
+        unsigned int avail = read_space();
+        if (n > avail) {
+            n = avail;
+        }
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + n,
+                     std::memory_order_release);
+        return n;
+    }
+};
+
+/* ------------- lock-free history of the newest samples ------------- */
+
+// Unlike RingBuffer the producer never waits for the consumer, it
+// overwrites the oldest samples. The consumer copies out a stretch of
+// recent samples and learns afterwards whether they were overwritten
+// during the copy.
+
+class HistoryBuffer {
+ private:
+    float          *m_data;
+    unsigned int    m_size;
+    unsigned int    m_mask;
+    // write position, owned by the producer
+    alignas(GX_CACHELINE_SIZE) std::atomic<unsigned int> m_head;
+ public:
+    explicit HistoryBuffer()
+        : m_data(0), m_size(0), m_mask(0), m_head(0) {}
+    ~HistoryBuffer() { delete[] m_data; }
+    // same rules as RingBuffer::set_size()
+    bool set_size(unsigned int size) {
+        unsigned int n = 1;
+        while (n < size) {
+            n <<= 1;
+        }
+        float *p = new float[n];
+        memset(p, 0, n * sizeof(*p));
+        delete[] m_data;
+        m_data = p;
+        m_size = n;
+        m_mask = n - 1;
+        m_head.store(0, std::memory_order_relaxed);
+        return true;
+    }
+    unsigned int size() const { return m_size; }
+
+    // ---- producer side
+    unsigned int write_position() const {
+        return m_head.load(std::memory_order_relaxed);
+    }
+    void write(const float *src, unsigned int n) {
+        unsigned int head = m_head.load(std::memory_order_relaxed);
+        // only the newest m_size samples survive anyway
+        if (n > m_size) {
+            head += n - m_size;
+            src += n - m_size;
+            n = m_size;
+        }
+        // move the position first, a reader which copied the old
+        // samples meanwhile sees it when it checks again
+        m_head.store(head + n, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        unsigned int idx = head & m_mask;
+        unsigned int cnt = (n < m_size - idx) ? n : m_size - idx;
+        memcpy(&m_data[idx], src, cnt * sizeof(*src));
+        memcpy(m_data, src + cnt, (n - cnt) * sizeof(*src));
+    }
+
+    // ---- consumer side
+    // copy the n samples in front of position end, false if they are
+    // not or no longer all there. end must come from a write position
+    // which the producer handed over after write() returned.
+    bool read(float *dst, unsigned int n, unsigned int end) const {
+        unsigned int head = m_head.load(std::memory_order_acquire);
+        if (n > m_size || head - end > m_size - n) {
+            return false;
+        }
+        unsigned int idx = (end - n) & m_mask;
+        unsigned int cnt = (n < m_size - idx) ? n : m_size - idx;
+        memcpy(dst, &m_data[idx], cnt * sizeof(*dst));
+        memcpy(dst + cnt, m_data, (n - cnt) * sizeof(*dst));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        head = m_head.load(std::memory_order_relaxed);
+        return head - end <= m_size - n;
+    }
+};
+
+#endif  // GX_RINGBUFFER_H_
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_signalgen.cpp      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "./gx_signalgen.h"
+
+#include <cmath>
+
+static const char *names[SignalGen::KINDS] = { "sine", "saw", "noise", "pluck" };
+// default peak level, well above the threshold of the tracker
+static const float DEFAULT_LEVEL = 0.3;
+// time constant of the fundamental of the pluck (seconds), partial h
+// dies away 1 + PLUCK_DAMPING * (h-1) times faster
+static const double PLUCK_DECAY = 1.5;
+static const double PLUCK_DAMPING = 0.3;
+
+SignalGen::SignalGen()
+    : kind(SINE),
+      samplerate(48000),
+      partials(0),
+      restart(0),
+      period(0),
+      level(DEFAULT_LEVEL),
+      seed(1) {
+}
+
+void SignalGen::setup(int k, double freq, int sr, double inharmonicity,
+                      double p) {
+    kind = k;
+    samplerate = sr;
+    period = static_cast<int>(p * sr);
+    restart = 0;
+    partials = 0;
+    int n = (kind == SINE) ? 1 : (kind == NOISE) ? 0 : MAX_PARTIALS;
+    // the saw and the pluck get the 1/h spectrum of a sawtooth, scaled
+    // to a peak of 1 at most
+    double sum = 0.0;
+    for (int h = 1; h <= n; h++) {
+        double f = h * freq * sqrt(1.0 + inharmonicity * h * h);
+        if (f >= 0.5 * sr) {
+            break;
+        }
+        step[partials] = 2 * M_PI * f / sr;
+        phase[partials] = 0.0;
+        amp[partials] = 1.0 / h;
+        decay[partials] = (kind == PLUCK) ?
+                          exp(-(1.0 + PLUCK_DAMPING * (h - 1)) / (PLUCK_DECAY * sr)) : 1.0;
+        sum += amp[partials];
+        partials++;
+    }
+    for (int i = 0; i < partials; i++) {
+        amp[i] /= sum;
+        gain[i] = amp[i];
+    }
+}
+
+// xorshift, the same sequence on every run
+float SignalGen::noise() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return static_cast<float>(seed) / 2147483648.0f - 1.0f;
+}
+
+void SignalGen::generate(int count, float *output) {
+    if (kind == NOISE) {
+        for (int j = 0; j < count; j++) {
+            output[j] = level * noise();
+        }
+        return;
+    }
+    for (int j = 0; j < count; j++) {
+        if (kind == PLUCK && --restart <= 0) {
+            restart = period;
+            for (int i = 0; i < partials; i++) {
+                gain[i] = amp[i];
+            }
+        }
+        double v = 0.0;
+        for (int i = 0; i < partials; i++) {
+            v += gain[i] * sin(phase[i]);
+            phase[i] += step[i];
+            gain[i] *= decay[i];
+        }
+        output[j] = level * static_cast<float>(v);
+    }
+    // keep the phases small for the precision of sin()
+    for (int i = 0; i < partials; i++) {
+        phase[i] = fmod(phase[i], 2 * M_PI);
+    }
+}
+
+const char *SignalGen::name(int k) {
+    return (k >= 0 && k < KINDS) ? names[k] : "";
+}
+
+int SignalGen::find(const std::string& n) {
+    for (int k = 0; k < KINDS; k++) {
+        if (n == names[k]) {
+            return k;
+        }
+    }
+    return -1;
+}
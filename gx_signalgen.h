@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_signalgen.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_SIGNALGEN_H_
+#define GX_SIGNALGEN_H_
+
+#include <stdint.h>
+
+#include <string>
+
+/* ------------- synthetic test signals ------------- */
+
+// Sines, sawtooths, white noise and plucked strings for the benchmark
+// and the tests of the tracker. The partials of the sawtooth and the
+// pluck can be stretched like those of a stiff string: partial h sits
+// at h * f * sqrt(1 + B*h*h), B is about 1e-4 for a guitar string.
+// Only partials below half the sample rate are generated.
+
+class SignalGen {
+ public:
+    enum { SINE, SAW, NOISE, PLUCK, KINDS };
+    explicit SignalGen();
+    // kind of signal, fundamental in Hz and inharmonicity B, the pluck
+    // starts again every period seconds
+    void            setup(int kind, double freq, int samplerate,
+                          double inharmonicity = 0.0, double period = 2.0);
+    void            set_level(float v) { level = v; }
+    // next count samples, restarts the pluck but keeps the phases
+    void            generate(int count, float *output);
+    // name of a kind, and the kind of a name (-1 == unknown)
+    static const char *name(int kind);
+    static int      find(const std::string& name);
+ private:
+    enum { MAX_PARTIALS = 32 };
+    int             kind;
+    int             samplerate;
+    int             partials;
+    // phase increment, phase, amplitude and decay per sample of the
+    // partials
+    double          step[MAX_PARTIALS];
+    double          phase[MAX_PARTIALS];
+    double          amp[MAX_PARTIALS];
+    double          decay[MAX_PARTIALS];
+    double          gain[MAX_PARTIALS];
+    // samples until the pluck starts again
+    int             restart;
+    int             period;
+    float           level;
+    // state of the noise generator
+    uint32_t        seed;
+    float           noise();
+};
+
+#endif  // GX_SIGNALGEN_H_
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_tracker_pool.cpp      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "./gx_tracker_pool.h"
+
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+// the watching worker sleeps until the next hop of any channel is
+// due, but looks again at least this often (seconds) for an onset
+static const double MAX_WATCH_WAIT = 0.005;
+static const double MIN_WATCH_WAIT = 0.0005;
+// while every channel is idle it sleeps until a gate opens, but looks
+// this often (s) to drop the samples added meanwhile
+static const double IDLE_WAIT = 0.25;
+
+TrackerPool::TrackerPool(int nthreads)
+    : m_channels(),
+      m_workers(),
+      m_nthreads(nthreads),
+      m_running(false),
+      m_watching(false) {
+    sem_init(&m_wakeup, 0, 0);
+}
+
+TrackerPool::~TrackerPool() {
+    stop();
+    for (unsigned int i = 0; i < m_channels.size(); i++) {
+        delete m_channels[i];
+    }
+    sem_destroy(&m_wakeup);
+}
+
+void TrackerPool::add(PitchTracker *tracker) {
+    tracker->set_threaded(false);
+    Channel *c = new Channel;
+    c->tracker = tracker;
+    c->busy.store(false, std::memory_order_relaxed);
+    m_channels.push_back(c);
+}
+
+bool TrackerPool::start(pthread_t j_thread) {
+    if (m_running.load() || m_channels.empty()) {
+        return false;
+    }
+    int n = m_nthreads;
+    if (n <= 0) {
+        n = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    if (n > static_cast<int>(m_channels.size())) {
+        n = m_channels.size();
+    }
+    if (n < 1) {
+        n = 1;
+    }
+    // all workers exist before the first one runs, run() reads m_workers
+    for (int i = 0; i < n; i++) {
+        Worker *w = new Worker;
+        w->pool = this;
+        w->index = i;
+        w->thread = 0;
+        m_workers.push_back(w);
+    }
+    m_running.store(true);
+    for (int i = 0; i < n; i++) {
+        if (!PitchTracker::start_rt_thread(&m_workers[i]->thread, j_thread,
+                                           static_run,
+                                           reinterpret_cast<void*>(m_workers[i]))) {
+            stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+void TrackerPool::stop() {
+    if (!m_running.load()) {
+        return;
+    }
+    // the waiting workers see it at once, the watching one within
+    // IDLE_WAIT
+    m_running.store(false);
+    for (unsigned int i = 0; i < m_workers.size(); i++) {
+        sem_post(&m_wakeup);
+    }
+    for (unsigned int i = 0; i < m_workers.size(); i++) {
+        if (m_workers[i]->thread) {
+            pthread_join(m_workers[i]->thread, NULL);
+        }
+        delete m_workers[i];
+    }
+    m_workers.clear();
+}
+
+void *TrackerPool::static_run(void *p) {
+    Worker *w = reinterpret_cast<Worker *>(p);
+    w->pool->run(w->index);
+    return NULL;
+}
+
+// analyse one hop of the channel, unless an other worker has it
+bool TrackerPool::run_channel(Channel *c) {
+    if (c->tracker->time_to_ready() > 0.0) {
+        return false;
+    }
+    if (c->busy.exchange(true, std::memory_order_acquire)) {
+        return false;
+    }
+    bool done = c->tracker->analyse();
+    c->busy.store(false, std::memory_order_release);
+    return done;
+}
+
+// sleep on the eventfds of the trackers while every one is idle,
+// false (at once) when one isn't
+bool TrackerPool::wait_idle() {
+    const int nchannels = m_channels.size();
+    struct pollfd p[MAX_CHANNELS];
+    int n = 0;
+    for (; n < nchannels && n < MAX_CHANNELS; n++) {
+        if (!m_channels[n]->tracker->arm_wakeup()) {
+            break;
+        }
+        p[n].fd = m_channels[n]->tracker->wakeup_fd();
+        p[n].events = POLLIN;
+    }
+    if (n == nchannels) {
+        poll(p, n, static_cast<int>(IDLE_WAIT * 1000));
+    }
+    for (int i = 0; i < n; i++) {
+        m_channels[i]->tracker->disarm_wakeup();
+    }
+    return n == nchannels;
+}
+
+// sleep until the first hop of a channel no worker has is due, or
+// on the eventfds while every channel is idle, and return the number
+// of channels ready then. An idle channel only has stale samples, the
+// next pass drops them.
+int TrackerPool::watch() {
+    const int nchannels = m_channels.size();
+    if (!wait_idle()) {
+        double t = MAX_WATCH_WAIT;
+        for (int i = 0; i < nchannels; i++) {
+            if (m_channels[i]->busy.load(std::memory_order_relaxed) ||
+                m_channels[i]->tracker->idle()) {
+                continue;
+            }
+            double r = m_channels[i]->tracker->time_to_ready();
+            if (r < t) {
+                t = r;
+            }
+        }
+        if (t < MIN_WATCH_WAIT) {
+            t = MIN_WATCH_WAIT;
+        }
+        struct timespec ts;
+        ts.tv_sec = 0;
+        ts.tv_nsec = static_cast<long>(t * 1e9);
+        nanosleep(&ts, NULL);
+    }
+    int ready = 0;
+    for (int i = 0; i < nchannels; i++) {
+        if (!m_channels[i]->busy.load(std::memory_order_relaxed) &&
+            !m_channels[i]->tracker->idle() &&
+            m_channels[i]->tracker->time_to_ready() <= 0.0) {
+            ready++;
+        }
+    }
+    return ready;
+}
+
+// One worker at a time watches the clock and the gates for the
+// others, which wait on m_wakeup meanwhile. The watcher wakes one
+// worker per ready channel, one of them takes over the watch.
+void TrackerPool::run(int index) {
+    const int nchannels = m_channels.size();
+    const int nworkers = m_workers.size();
+    while (m_running.load(std::memory_order_relaxed)) {
+        bool done = false;
+        // own channels first, then the ones of the others, one hop per
+        // channel and pass so that a busy channel can't starve the rest
+        for (int k = 0; k < nworkers; k++) {
+            int owner = (index + k) % nworkers;
+            for (int i = owner; i < nchannels; i += nworkers) {
+                done |= run_channel(m_channels[i]);
+            }
+        }
+        if (done) {
+            continue;
+        }
+        if (!m_watching.exchange(true, std::memory_order_acquire)) {
+            int ready = watch();
+            m_watching.store(false, std::memory_order_release);
+            for (int i = 0; i < ready && i < nworkers - 1; i++) {
+                sem_post(&m_wakeup);
+            }
+            continue;
+        }
+        sem_wait(&m_wakeup);
+    }
+}
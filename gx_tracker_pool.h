@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_tracker_pool.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_TRACKER_POOL_H_
+#define GX_TRACKER_POOL_H_
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <atomic>
+#include <vector>
+
+#include "./gx_pitch_tracker.h"
+
+/* ------------- shared analysis threads for many trackers ------------- */
+
+// Every tracker (channel) added to the pool is owned by one worker, the
+// channels are dealt out round robin. There are no queues per worker:
+// all of them scan the same list of channels, their own first, then
+// the ones of the others. A channel is claimed with an atomic flag, so
+// one hop is never analysed twice and a channel never runs on two
+// workers. A worker which finds nothing to do either watches for the
+// next hop (one worker at a time) or blocks on a semaphore until the
+// watcher has work for it. While every channel is idle the watcher
+// sleeps on the eventfds of the trackers, which add() writes once when
+// a gate opens.
+
+class TrackerPool {
+ private:
+    // channels the watcher sleeps on while all are idle, a pool with
+    // more polls them
+    enum { MAX_CHANNELS = 64 };
+    struct Channel {
+        PitchTracker       *tracker;
+        // set while a worker analyses this channel
+        std::atomic<bool>   busy;
+    };
+    struct Worker {
+        TrackerPool        *pool;
+        int                 index;
+        pthread_t           thread;
+    };
+    std::vector<Channel*> m_channels;
+    std::vector<Worker*>  m_workers;
+    // requested number of workers, 0 == one per core
+    int                 m_nthreads;
+    std::atomic<bool>   m_running;
+    // set while a worker watches for the others
+    std::atomic<bool>   m_watching;
+    // posted by the watcher for the ready channels, by stop() for all
+    sem_t               m_wakeup;
+    static void         *static_run(void *p);
+    void                run(int index);
+    bool                run_channel(Channel *c);
+    bool                wait_idle();
+    int                 watch();
+ public:
+    explicit TrackerPool(int nthreads = 0);
+    ~TrackerPool();
+    // hand a tracker over to the pool, before init() of the tracker
+    void                add(PitchTracker *tracker);
+    // start the workers at the priority of the analysis threads
+    bool                start(pthread_t j_thread);
+    void                stop();
+    int                 get_threads() { return m_workers.size(); }
+};
+
+#endif  // GX_TRACKER_POOL_H_
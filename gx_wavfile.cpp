@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_wavfile.cpp      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "./gx_wavfile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+#ifdef HAVE_SNDFILE
+#include <sndfile.h>
+#endif
+
+// all fields of the wav header are little endian
+static inline uint32_t le16(const unsigned char *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t le32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+#ifdef HAVE_SNDFILE
+// libsndfile reads the file from the memory load() put it in
+struct SoundDecoder {
+    SNDFILE        *file;
+    const unsigned char *data;
+    sf_count_t      size;
+    sf_count_t      pos;
+    // interleaved frames of one read()
+    std::vector<float> buffer;
+};
+
+static sf_count_t vio_length(void *p) {
+    return static_cast<SoundDecoder*>(p)->size;
+}
+
+static sf_count_t vio_seek(sf_count_t offset, int whence, void *p) {
+    SoundDecoder *d = static_cast<SoundDecoder*>(p);
+    if (whence == SEEK_CUR) {
+        offset += d->pos;
+    } else if (whence == SEEK_END) {
+        offset += d->size;
+    }
+    if (offset < 0 || offset > d->size) {
+        return -1;
+    }
+    d->pos = offset;
+    return offset;
+}
+
+static sf_count_t vio_read(void *ptr, sf_count_t count, void *p) {
+    SoundDecoder *d = static_cast<SoundDecoder*>(p);
+    if (count > d->size - d->pos) {
+        count = d->size - d->pos;
+    }
+    memcpy(ptr, d->data + d->pos, count);
+    d->pos += count;
+    return count;
+}
+
+static sf_count_t vio_write(const void *ptr, sf_count_t count, void *p) {
+    return 0;
+}
+
+static sf_count_t vio_tell(void *p) {
+    return static_cast<SoundDecoder*>(p)->pos;
+}
+#else
+struct SoundDecoder {
+};
+#endif
+
+WavFile::WavFile()
+    : m_data(0),
+      m_size(0),
+      m_mapped(false),
+      m_samples(0),
+      m_frames(0),
+      m_position(0),
+      m_format(0),
+      m_bits(0),
+      m_channels(0),
+      m_samplerate(0),
+      m_frameSize(0),
+      m_error(),
+      m_decoder(0) {
+}
+
+WavFile::~WavFile() {
+    close();
+}
+
+void WavFile::close() {
+#ifdef HAVE_SNDFILE
+    if (m_decoder) {
+        sf_close(m_decoder->file);
+    }
+#endif
+    delete m_decoder;
+    m_decoder = 0;
+    if (m_mapped) {
+        munmap(m_data, m_size);
+    } else {
+        free(m_data);
+    }
+    m_data = 0;
+    m_size = 0;
+    m_mapped = false;
+    m_samples = 0;
+    m_frames = m_position = 0;
+}
+
+bool WavFile::open(const char *name) {
+    close();
+    int fd = ::open(name, O_RDONLY);
+    if (fd < 0) {
+        m_error = strerror(errno);
+        return false;
+    }
+    bool ok = load(fd);
+    ::close(fd);
+    if (ok && !(is_wav() ? parse() : open_decoder())) {
+        close();
+        return false;
+    }
+    return ok;
+}
+
+// map the file, the kernel reads ahead as the analysis walks through
+// it. Whatever can't be mapped (a pipe) is read into memory instead.
+bool WavFile::load(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            m_data = static_cast<unsigned char*>(p);
+            m_size = st.st_size;
+            m_mapped = true;
+            return true;
+        }
+    }
+    size_t capacity = 0;
+    for (;;) {
+        if (m_size == capacity) {
+            capacity = capacity ? 2 * capacity : 1 << 20;
+            unsigned char *p = static_cast<unsigned char*>(realloc(m_data, capacity));
+            if (!p) {
+                m_error = "out of memory";
+                return false;
+            }
+            m_data = p;
+        }
+        ssize_t n = ::read(fd, m_data + m_size, capacity - m_size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            m_error = strerror(errno);
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+        m_size += n;
+    }
+}
+
+bool WavFile::is_wav() const {
+    return m_size >= 12 && !memcmp(m_data, "RIFF", 4) && !memcmp(m_data + 8, "WAVE", 4);
+}
+
+// walk the chunks for "fmt " and "data"
+bool WavFile::parse() {
+    if (!is_wav()) {
+        m_error = "not a wav file";
+        return false;
+    }
+    const unsigned char *fmt = 0;
+    size_t pos = 12;
+    while (pos + 8 <= m_size) {
+        const unsigned char *chunk = m_data + pos;
+        size_t size = le32(chunk + 4);
+        if (!memcmp(chunk, "fmt ", 4) && size >= 16 && pos + 8 + size <= m_size) {
+            fmt = chunk + 8;
+        } else if (!memcmp(chunk, "data", 4)) {
+            // the size of a recording which was never finished may be
+            // wrong, take what is there
+            if (size > m_size - pos - 8) {
+                size = m_size - pos - 8;
+            }
+            m_samples = chunk + 8;
+            m_frames = size;
+            break;
+        }
+        // chunks are padded to an even size
+        pos += 8 + size + (size & 1);
+    }
+    if (!fmt || !m_samples) {
+        m_error = "no fmt or data chunk";
+        return false;
+    }
+    m_format = le16(fmt);
+    m_channels = le16(fmt + 2);
+    m_samplerate = le32(fmt + 4);
+    m_bits = le16(fmt + 14);
+    if (m_format == FORMAT_EXTENSIBLE && le16(fmt - 4) >= 40) {
+        // the first two bytes of the sub format guid are the format
+        m_format = le16(fmt + 24);
+    }
+    bool pcm = (m_format == FORMAT_PCM &&
+                (m_bits == 8 || m_bits == 16 || m_bits == 24 || m_bits == 32));
+    bool flt = (m_format == FORMAT_FLOAT && (m_bits == 32 || m_bits == 64));
+    if (!(pcm || flt) || m_channels < 1 || m_samplerate < 1) {
+        m_error = "unsupported sample format";
+        return false;
+    }
+    m_frameSize = m_channels * m_bits / 8;
+    m_frames /= m_frameSize;
+    m_position = 0;
+    return true;
+}
+
+float WavFile::sample(const unsigned char *p) const {
+    if (m_format == FORMAT_FLOAT) {
+        if (m_bits == 32) {
+            uint32_t u = le32(p);
+            float f;
+            memcpy(&f, &u, sizeof(f));
+            return f;
+        }
+        uint64_t u = le32(p) | (static_cast<uint64_t>(le32(p + 4)) << 32);
+        double d;
+        memcpy(&d, &u, sizeof(d));
+        return d;
+    }
+    switch (m_bits) {
+    case 8:
+        return (p[0] - 128) * (1.0f / 128);
+    case 16:
+        return static_cast<int16_t>(le16(p)) * (1.0f / 32768);
+    case 24:
+        return static_cast<int32_t>((p[0] << 8) | (p[1] << 16) |
+                                    (static_cast<uint32_t>(p[2]) << 24)) * (1.0f / 2147483648.0f);
+    default:
+        return static_cast<int32_t>(le32(p)) * (1.0f / 2147483648.0f);
+    }
+}
+
+// every other format goes to libsndfile, when there is one
+bool WavFile::open_decoder() {
+#ifdef HAVE_SNDFILE
+    SoundDecoder *d = new SoundDecoder;
+    d->data = m_data;
+    d->size = m_size;
+    d->pos = 0;
+    SF_VIRTUAL_IO vio = { vio_length, vio_seek, vio_read, vio_write, vio_tell };
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    d->file = sf_open_virtual(&vio, SFM_READ, &info, d);
+    if (!d->file) {
+        m_error = sf_strerror(NULL);
+        delete d;
+        return false;
+    }
+    m_decoder = d;
+    m_channels = info.channels;
+    m_samplerate = info.samplerate;
+    m_frames = info.frames;
+    m_position = 0;
+    if (m_channels < 1 || m_samplerate < 1) {
+        m_error = "unsupported sample format";
+        return false;
+    }
+    return true;
+#else
+    m_error = "not a wav file (flac needs a build with libsndfile)";
+    return false;
+#endif
+}
+
+// the buffer only grows, to the largest count asked for
+int WavFile::read_decoded(int count, float *output) {
+#ifdef HAVE_SNDFILE
+    std::vector<float>& buffer = m_decoder->buffer;
+    if (buffer.size() < static_cast<size_t>(count) * m_channels) {
+        buffer.resize(static_cast<size_t>(count) * m_channels);
+    }
+    sf_count_t n = sf_readf_float(m_decoder->file, &buffer[0], count);
+    if (n <= 0) {
+        return 0;
+    }
+    const float scale = 1.0f / m_channels;
+    const float *p = &buffer[0];
+    for (int i = 0; i < n; i++) {
+        float v = 0.0f;
+        for (int c = 0; c < m_channels; c++) {
+            v += *p++;
+        }
+        output[i] = v * scale;
+    }
+    m_position += n;
+    return n;
+#else
+    return 0;
+#endif
+}
+
+int WavFile::read(int count, float *output) {
+    if (m_decoder) {
+        return read_decoded(count, output);
+    }
+    if (count > m_frames - m_position) {
+        count = m_frames - m_position;
+    }
+    const int bytes = m_bits / 8;
+    const float scale = 1.0f / m_channels;
+    const unsigned char *p = m_samples + m_position * m_frameSize;
+    for (int i = 0; i < count; i++) {
+        float v = 0.0f;
+        for (int c = 0; c < m_channels; c++) {
+            v += sample(p);
+            p += bytes;
+        }
+        output[i] = v * scale;
+    }
+    m_position += count;
+    return count;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 Hermann Meyer, Andreas Degert, Hans Bezemer
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * ---------------------------------------------------------------------------
+ *
+ *        file: gx_wavfile.h      guitar tuner for jack
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#pragma once
+
+#ifndef GX_WAVFILE_H_
+#define GX_WAVFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+/* ------------- wav file reader ------------- */
+
+// RIFF/WAVE files with 8, 16, 24 or 32 bit integer or 32 or 64 bit
+// float samples, also in the extensible format. The file is mapped
+// into memory, or read in one go when it can't be mapped, and the
+// channels are mixed down to mono on the fly. When built with
+// libsndfile (HAVE_SNDFILE) every other file, flac, ogg or aiff, is
+// decoded from the same memory by it.
+
+// the libsndfile state of a file which isn't a wav file
+struct SoundDecoder;
+
+class WavFile {
+ public:
+    explicit WavFile();
+    ~WavFile();
+    // false, with the reason in error(), when the file can't be read or
+    // isn't a supported wav (or libsndfile) file
+    bool            open(const char *name);
+    void            close();
+    int             samplerate() const { return m_samplerate; }
+    int             channels() const { return m_channels; }
+    // may be unknown (huge) for a decoded file
+    int64_t         frames() const { return m_frames; }
+    // the next count frames mixed down to mono, the number of frames
+    // read, 0 at the end of the file
+    int             read(int count, float *output);
+    const std::string& error() const { return m_error; }
+ private:
+    enum { FORMAT_PCM = 1, FORMAT_FLOAT = 3, FORMAT_EXTENSIBLE = 0xfffe };
+    // the whole file, mapped or from malloc()
+    unsigned char  *m_data;
+    size_t          m_size;
+    bool            m_mapped;
+    // first sample of the data chunk
+    const unsigned char *m_samples;
+    int64_t         m_frames;
+    int64_t         m_position;
+    int             m_format;
+    int             m_bits;
+    int             m_channels;
+    int             m_samplerate;
+    // bytes per frame
+    int             m_frameSize;
+    std::string     m_error;
+    // 0 == a wav file read by parse() and sample()
+    SoundDecoder   *m_decoder;
+    bool            load(int fd);
+    bool            is_wav() const;
+    bool            parse();
+    float           sample(const unsigned char *p) const;
+    bool            open_decoder();
+    int             read_decoded(int count, float *output);
+};
+
+#endif  // GX_WAVFILE_H_
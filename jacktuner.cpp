@@ -22,13 +22,21 @@
  */
 
 #include "./jacktuner.h"
+#include "./gx_midi_out.h"
+#include "./gx_realtime.h"
 
-JackTuner::JackTuner() {}
+#include <jack/midiport.h>
+#include <unistd.h>
+
+// periods stop() waits for the last midi events to go out
+static const int STOP_PERIODS = 4;
+
+JackTuner::JackTuner() : midi_out(0), headless(false), midi_port(0), client(0) {}
 JackTuner::~JackTuner() {}
 
-bool JackTuner::gx_jack_init(std::string jack_uuid) {
+bool JackTuner::gx_jack_init(std::string jack_uuid, int inputs) {
     client_name =   "gxtuner";
-    input_port  =   0;
+    input_ports.clear();
 #ifdef HAVE_JACK_SESSION
     if (!jack_uuid.empty()) {
         client = jack_client_open (client_name.c_str(), jack_options_t(
@@ -44,14 +52,24 @@ bool JackTuner::gx_jack_init(std::string jack_uuid) {
         jack_sr = jack_get_sample_rate(client); // jack sample rate
         jack_bs = jack_get_buffer_size(client); // jack buffer size
         jack_set_process_callback(client, gx_jack_process, 0); // compute
+        jack_set_buffer_size_callback(client, gx_jack_buffersize, 0);
+        jack_set_thread_init_callback(client, gx_jack_thread_init, 0);
         jack_on_shutdown (client, jack_shutdown, 0);  // shutdown clean up
 #ifdef HAVE_JACK_SESSION
-        if (jack_set_session_callback) {
+        if (jack_set_session_callback && !headless) {
             jack_set_session_callback(client, gx_jack_session_callback, 0);
         }
 #endif
-        input_port = jack_port_register(client, "in_0", JACK_DEFAULT_AUDIO_TYPE,
-                     JackPortIsInput|JackPortIsTerminal, 0);
+        for (int i = 0; i < inputs; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "in_%i", i);
+            input_ports.push_back(jack_port_register(client, name,
+                     JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput|JackPortIsTerminal, 0));
+        }
+        if (midi_out) {
+            midi_port = jack_port_register(client, "midi_out",
+                     JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput|JackPortIsTerminal, 0);
+        }
     } else {
         fprintf (stderr, "connection to jack failed, . . exit\n");
         exit(1);
@@ -60,6 +78,23 @@ bool JackTuner::gx_jack_init(std::string jack_uuid) {
     return true;
 }
 
+// jack_in is a comma separated list, the n'th name goes to in_n
+void JackTuner::gx_jack_connect(std::string jack_in) {
+    size_t start = 0;
+    for (unsigned int i = 0; i < input_ports.size(); i++) {
+        size_t end = jack_in.find(',', start);
+        std::string port = jack_in.substr(start, end - start);
+        if (!port.empty()) {
+            jack_connect(client, port.c_str(),
+                         jack_port_name(input_ports[i]));
+        }
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
 void JackTuner::gx_jack_activate(std::string jack_uuid, std::string jack_in) {
     if (jack_activate (client)) {
         fprintf (stderr, "cannot activate client\n");
@@ -67,27 +102,82 @@ void JackTuner::gx_jack_activate(std::string jack_uuid, std::string jack_in) {
     } else {
 #ifdef HAVE_JACK_SESSION
         if (!jack_in.empty() && jack_uuid.empty()) {
-            jack_connect(client, jack_in.c_str(),
-                         jack_port_name(input_port));
+            gx_jack_connect(jack_in);
         }
 #else
         if (!jack_in.empty()) {
-            jack_connect(client, jack_in.c_str(),
-                         jack_port_name(input_port));
+            gx_jack_connect(jack_in);
         }
 #endif
     }
 }
 
+bool JackTuner::start() {
+    gx_jack_activate(session_uuid, connect_to);
+    return true;
+}
+
+void JackTuner::stop() {
+    if (!client) {
+        return;
+    }
+    // a last period turns off the notes which still sound, a jack
+    // which doesn't run it any more gets STOP_PERIODS to do so
+    if (midi_port) {
+        midi_out->stop();
+        for (int i = 0; i < STOP_PERIODS && !midi_out->stopped(); i++) {
+            usleep(static_cast<useconds_t>(1e6 * jack_bs / jack_sr));
+        }
+    }
+    // no process callback may run while the ports go away
+    jack_deactivate(client);
+    for (unsigned int i = 0; i < input_ports.size(); i++) {
+        jack_port_unregister(client, input_ports[i]);
+    }
+    if (midi_port) {
+        jack_port_unregister(client, midi_port);
+        midi_port = 0;
+    }
+    jack_client_close(client);
+    client = 0;
+}
+
 void JackTuner::jack_shutdown (void *arg) {fptr->qt();}
 
 int JackTuner::gx_jack_process(jack_nframes_t nframes, void *arg) {
-    float *input = static_cast<float *>
-                       (jack_port_get_buffer(jt.input_port, nframes));
-    fptr->pt(nframes, input);
+    gx_rt_enter();
+    for (unsigned int i = 0; i < jt.input_ports.size(); i++) {
+        float *input = static_cast<float *>
+                       (jack_port_get_buffer(jt.input_ports[i], nframes));
+        jt.m_process(i, nframes, input);
+    }
+    // the estimates which came in since the last period
+    if (jt.midi_port) {
+        void *buffer = jack_port_get_buffer(jt.midi_port, nframes);
+        jack_midi_clear_buffer(buffer);
+        jt.midi_out->process(jack_last_frame_time(jt.client), nframes);
+        for (int i = 0; i < jt.midi_out->count(); i++) {
+            const MidiEvent& e = jt.midi_out->event(i);
+            jack_midi_event_write(buffer, e.offset, e.data, e.size);
+        }
+    }
+    gx_rt_leave();
     return 0;
 }
 
+// resize the scratch buffers of the trackers, outside of the process
+// callback, so the process callback never has to allocate
+int JackTuner::gx_jack_buffersize(jack_nframes_t nframes, void *arg) {
+    jt.jack_bs = nframes;
+    fptr->bs(nframes);
+    return 0;
+}
+
+// runs once in the realtime thread before the first process callback
+void JackTuner::gx_jack_thread_init(void *arg) {
+    gx_rt_prefault_stack();
+}
+
 #ifdef HAVE_JACK_SESSION
 int JackTuner::gx_jack_session_callback_helper(void* arg) {
     jack_session_event_t *event = static_cast<jack_session_event_t *>(arg);
@@ -103,6 +193,14 @@ int JackTuner::gx_jack_session_callback_helper(void* arg) {
     char buffer [100];
     sprintf (buffer, " -x %i -y %i -w %i -l %i -p %f -t %f -d %i",x, y, w, l, p, t, d);
     cmd += buffer;
+    if (jt.input_ports.size() > 1) {
+        sprintf (buffer, " --inputs %i", static_cast<int>(jt.input_ports.size()));
+        cmd += buffer;
+    }
+    if (jt.midi_out) {
+        sprintf (buffer, " --midi-out --bend-range %i", jt.midi_out->get_bend_range());
+        cmd += buffer;
+    }
     event->command_line = strdup(cmd.c_str());
 
     jack_session_reply(jt.client, event);
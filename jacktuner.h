@@ -37,7 +37,14 @@
 #endif
 
 #include <string> 
+#include <vector>
 #include <cstdlib>
+
+#include "./gx_audio_source.h"
+
+#define MAX_INPUTS          (16)
+
+class MidiOut;
     
 typedef void (*funcpointer)
              (int* x, int* y, int* w, int* l);
@@ -47,15 +54,25 @@ typedef void (*getintpointer)
              (int* x);
 typedef void (*npointer)
              ();
-typedef void (*gettracker)
-             (int x, float *input);
+typedef void (*setperiod)
+             (int x);
 
-class JackTuner {
+class JackTuner : public AudioSource {
  private:
     jack_status_t       jackstat;
     std::string         client_name;
+    // session uuid and ports to connect to, for open() and start()
+    std::string         session_uuid;
+    std::string         connect_to;
+    // estimates to midi, 0 == no midi port
+    MidiOut*            midi_out;
+    // without window, the session reply needs one
+    bool                headless;
     static void         jack_shutdown (void *arg);
     static int          gx_jack_process(jack_nframes_t nframes, void *arg);
+    static int          gx_jack_buffersize(jack_nframes_t nframes, void *arg);
+    static void         gx_jack_thread_init(void *arg);
+    void                gx_jack_connect(std::string jack_in);
 #ifdef HAVE_JACK_SESSION
     static void         gx_jack_session_callback(jack_session_event_t *event, void *arg);
     static int          gx_jack_session_callback_helper(void* arg);
@@ -63,13 +80,31 @@ class JackTuner {
  public:
     explicit JackTuner();
     ~JackTuner();
-    jack_port_t*        input_port;
+    std::vector<jack_port_t*> input_ports; // in_0 .. in_N-1
+    jack_port_t*        midi_port; // midi_out, with set_midi_out()
     jack_client_t*      client;
     jack_nframes_t      jack_sr;   // jack sample rate
     jack_nframes_t      jack_bs;   // jack buffer size
     void                gx_jack_activate(std::string jack_uuid, std::string jack_in);
-    bool                gx_jack_init(std::string jack_uuid);
-    
+    bool                gx_jack_init(std::string jack_uuid, int inputs);
+    // the AudioSource, start() activates the client and connects it
+    void                set_session(std::string jack_uuid, std::string jack_in) {
+        session_uuid = jack_uuid;
+        connect_to = jack_in;
+    }
+    // register a midi output port for the events of m, before open()
+    void                set_midi_out(MidiOut *m) { midi_out = m; }
+    // no jack session callback, as no glib main loop runs to answer
+    // it, before open()
+    void                set_headless(bool v) { headless = v; }
+    virtual bool        open(int inputs) { return gx_jack_init(session_uuid, inputs); }
+    virtual bool        start();
+    virtual void        stop();
+    virtual int         samplerate() { return jack_sr; }
+    virtual int         period() { return jack_bs; }
+    virtual unsigned int last_frame_time() { return jack_last_frame_time(client); }
+    virtual unsigned int frame_time() { return jack_frame_time(client); }
+    virtual pthread_t   thread() { return jack_client_thread_id(client); }
 
 };
 extern JackTuner jt;
@@ -82,7 +117,7 @@ class FuncPtr {
     getintpointer       desk;
     npointer            ex;
     npointer            qt;
-    gettracker          pt;
+    setperiod           bs;
 };
 extern FuncPtr *fptr;
 
@@ -22,13 +22,29 @@
  */
 
 #include "./cmdparser.h"
+#include "./gx_analyze.h"
+#include "./gx_audio_source.h"
+#include "./gx_headless.h"
+#include "./gx_midi_out.h"
 #include "./gx_pitch_tracker.h"
+#include "./gx_tracker_pool.h"
 #include "./gxtuner.h"
 #include "./jacktuner.h"
 #include "./tuner.h"
 #include "./deskpager.h"
 
-
+// one tracker per jack input, owned by main()
+static std::vector<PitchTracker*> pitch_trackers;
+// analysis threads shared by the trackers when there is more than one
+static TrackerPool *tracker_pool = 0;
+// the input shown by the tuner widget
+static volatile int active_input = 0;
+// jt, or a file, stdin or the signal generator (--source)
+static AudioSource *source = 0;
+// --headless: the estimates go out as json lines instead of the window
+static HeadlessOutput *headless_output = 0;
+// --midi-out: the estimates as midi events, jack only
+static MidiOut *midi_out = 0;
 
 static void wrap_window_area(int* x, int* y, int* w, int* l) {
     tw.window_area(x, y, w, l);
@@ -39,18 +55,43 @@ static void wrap_get_reference_pitch(double* x) {
 }
 
 static void wrap_get_threshold(double* x) {
-    *x = pitch_tracker.get_threshold();
+    *x = pitch_trackers[active_input]->get_threshold();
 }
 
 static void wrap_session_quit() {
     tw.session_quit();
 }
 
-static void wrap_pitch_tracker_add(int x, float* input) {
-    pitch_tracker.add(x, input);
+// a fast source waits for the analysis of every period, so its ring
+// buffer never overflows and a run gives the same estimates every time
+static void wrap_pitch_tracker_add(int port, int x, float* input) {
+    pitch_trackers[port]->add(x, input, source->last_frame_time());
+    if (source->fast()) {
+        while (pitch_trackers[port]->analyse()) {
+        }
+    }
+}
+
+static bool wrap_source_drained() {
+    for (unsigned int i = 0; i < pitch_trackers.size(); i++) {
+        if (!pitch_trackers[i]->caught_up()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void wrap_set_max_period(int x) {
+    for (unsigned int i = 0; i < pitch_trackers.size(); i++) {
+        pitch_trackers[i]->set_max_period(x);
+    }
 }
 
 static void wrap_main_quit() {
+    if (headless_output) {
+        headless_output->quit();
+        return;
+    }
     gtk_main_quit ();
 }
 
@@ -58,20 +99,71 @@ static std::string wrap_get_optvar(int x) {
    return cmd.get_optvar(x);
 }
 
-static jack_port_t* wrap_input_port() {
-    return jt.input_port;
+static void wrap_close_source() {
+    source->stop();
+}
+
+static gboolean quit_idle(gpointer data) {
+    gtk_main_quit();
+    return FALSE;
 }
 
-static jack_client_t* wrap_client() {
-    return jt.client;
+// called from the thread of the source at the end of a file or of
+// stdin, gtk_main() may not even run yet
+static void wrap_source_finished() {
+    if (headless_output) {
+        headless_output->quit();
+        return;
+    }
+    g_idle_add(quit_idle, 0);
 }
 
 static float wrap_estimated_freq() {
-    return pitch_tracker.get_estimated_freq();
+    PitchResult r;
+    pitch_trackers[active_input]->get_result(&r);
+    // the tracker fell behind, don't show an estimate older than a second
+    if (static_cast<int>(source->frame_time() - r.frame_time) >
+            source->samplerate()) {
+        return 0;
+    }
+    return r.freq;
 }
 
 static void wrap_set_threshold(float x) {
-    pitch_tracker.set_threshold(x);
+    for (unsigned int i = 0; i < pitch_trackers.size(); i++) {
+        pitch_trackers[i]->set_threshold(x);
+    }
+}
+
+// the midi notes follow the reference pitch of the window
+static void wrap_set_reference_pitch(float x) {
+    if (midi_out) {
+        midi_out->set_reference_pitch(x);
+    }
+}
+
+static int wrap_get_inputs() {
+    return pitch_trackers.size();
+}
+
+static void wrap_set_input(int x) {
+    if (x >= 0 && x < static_cast<int>(pitch_trackers.size())) {
+        active_input = x;
+        tw.wake_up();
+    }
+}
+
+static bool wrap_is_idle() {
+    return pitch_trackers[active_input]->idle();
+}
+
+// called from the analysis threads, arg is the number of the input
+static void wrap_new_freq(void *arg) {
+    if (headless_output) {
+        headless_output->notify();
+    } else if (static_cast<int>(reinterpret_cast<intptr_t>(arg)) == active_input) {
+        tw.wake_up();
+    }
 }
 
 static void wrap_get_desk(int *x) {
@@ -84,51 +176,228 @@ static void set_pointers_to_f() {
     fptr->rp        = &wrap_get_reference_pitch;
     fptr->gt        = &wrap_get_threshold;
     fptr->ex        = &wrap_session_quit;
-    fptr->pt        = &wrap_pitch_tracker_add;
+    fptr->bs        = &wrap_set_max_period;
     fptr->qt        = &wrap_main_quit;
     fptr->desk      = &wrap_get_desk;
     
     cptr->cv        = &wrap_get_optvar;
-    cptr->gp        = &wrap_input_port;
-    cptr->gc        = &wrap_client;
+    cptr->cs        = &wrap_close_source;
     cptr->ef        = &wrap_estimated_freq;
     cptr->sf        = &wrap_set_threshold;
+    cptr->rf        = &wrap_set_reference_pitch;
+    cptr->ni        = &wrap_get_inputs;
+    cptr->si        = &wrap_set_input;
+    cptr->ii        = &wrap_is_idle;
+}
+
+// apply the engine options to a tracker
+static void setup_pitch_tracker(PitchTracker *pitch_tracker) {
+    if (!cptr->cv(WINDOW_SIZE).empty()) {
+        pitch_tracker->set_window_size(atoi(cptr->cv(WINDOW_SIZE).c_str()));
+    }
+    if (!cptr->cv(HOP_SIZE).empty()) {
+        pitch_tracker->set_hop_size(atoi(cptr->cv(HOP_SIZE).c_str()));
+    }
+    if (!cptr->cv(FREQ_RANGE).empty()) {
+        std::string r = cptr->cv(FREQ_RANGE);
+        size_t sep = r.find(':');
+        float fmax = (sep == std::string::npos) ? 0 : atof(r.substr(sep + 1).c_str());
+        pitch_tracker->set_frequency_range(atof(r.c_str()), fmax);
+    }
+    if (!cptr->cv(FFT_PAD).empty()) {
+        std::string f = cptr->cv(FFT_PAD);
+        if (f == "min") {
+            pitch_tracker->set_fft_padding(PitchTracker::FFT_PAD_MIN);
+        } else if (f == "pow2") {
+            pitch_tracker->set_fft_padding(PitchTracker::FFT_PAD_POW2);
+        } else {
+            pitch_tracker->set_fft_padding(PitchTracker::FFT_PAD_SMOOTH);
+        }
+    }
+    if (cptr->cv(ANALYSIS_RATE) == "native") {
+        pitch_tracker->set_native_rate(true);
+    }
+    if (!cptr->cv(ESTIMATOR).empty() &&
+        !pitch_tracker->set_estimator(cptr->cv(ESTIMATOR))) {
+        fprintf(stderr, "unknown estimator %s, using %s\n",
+                cptr->cv(ESTIMATOR).c_str(), pitch_tracker->get_estimator());
+    }
+}
+
+static void headless_signal_handler(int sig) {
+    headless_output->quit();
+}
+
+// --analyze: the arguments left over by the option parser are the
+// files, returns the exit status
+static int analyze_files(int argc, char *argv[]) {
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        files.push_back(argv[i]);
+    }
+    if (files.empty()) {
+        fprintf(stderr, "--analyze: no files given\n");
+        return 1;
+    }
+    BatchAnalyzer analyzer;
+    analyzer.set_setup(setup_pitch_tracker);
+    if (cptr->cv(OUTPUT_FORMAT) == "binary") {
+        analyzer.set_format(BatchAnalyzer::FORMAT_BINARY);
+    } else if (!cptr->cv(OUTPUT_FORMAT).empty() && cptr->cv(OUTPUT_FORMAT) != "csv") {
+        fprintf(stderr, "unknown output format %s, using csv\n",
+                cptr->cv(OUTPUT_FORMAT).c_str());
+    }
+    if (!cptr->cv(PITCH).empty()) {
+        analyzer.set_reference_pitch(atof(cptr->cv(PITCH).c_str()));
+    }
+    if (!cptr->cv(JOBS).empty()) {
+        analyzer.set_jobs(atoi(cptr->cv(JOBS).c_str()));
+    }
+    return analyzer.run(files) ? 0 : 1;
 }
 
 int main(int argc, char *argv[]) {
 
-    // trap signals to quit clean
-    signal(SIGTERM, tw.signal_handler);
-    signal(SIGHUP,  tw.signal_handler);
-    signal(SIGINT,  tw.signal_handler);
-    signal(SIGQUIT, tw.signal_handler);
-    // init thread system
-    tw.g_threads    = 0;
-    
     // process comandline options
     cmd.process_cmdline_options(argc, argv);
     // set pointers to function pointer classes
     fptr            = new FuncPtr;
     cptr            = new CmdPtr;
     set_pointers_to_f();
-    // init jack
-    jt.gx_jack_init(cptr->cv(JACK_UUID));
+    // offline analysis, neither jack nor gtk are touched
+    if (!cptr->cv(ANALYZE).empty()) {
+        int r = analyze_files(argc, argv);
+        delete fptr;
+        delete cptr;
+        return r;
+    }
+    // without window the estimates go to stdout or a socket
+    if (!cptr->cv(HEADLESS).empty()) {
+        headless_output = new HeadlessOutput;
+        if (!headless_output->open(cptr->cv(SOCKET))) {
+            return 1;
+        }
+        if (!cptr->cv(PITCH).empty()) {
+            headless_output->set_reference_pitch(atof(cptr->cv(PITCH).c_str()));
+        }
+    }
+    // trap signals to quit clean
+    void (*handler)(int) = headless_output ? headless_signal_handler : tw.signal_handler;
+    signal(SIGTERM, handler);
+    signal(SIGHUP,  handler);
+    signal(SIGINT,  handler);
+    signal(SIGQUIT, handler);
+    // init thread system
+    tw.g_threads    = 0;
+    // the source feeds the trackers as soon as it runs
+    int inputs      = 1;
+    if (!cptr->cv(JACK_INPUTS).empty()) {
+        inputs      = atoi(cptr->cv(JACK_INPUTS).c_str());
+        inputs      = inputs < 1 ? 1 : inputs > MAX_INPUTS ? MAX_INPUTS : inputs;
+    }
+    for (int i = 0; i < inputs; i++) {
+        pitch_trackers.push_back(new PitchTracker);
+    }
+    // one midi channel per input, set up before jack can run
+    if (!cptr->cv(MIDI_OUT).empty()) {
+        midi_out    = new MidiOut;
+        if (!cptr->cv(PITCH).empty()) {
+            midi_out->set_reference_pitch(atof(cptr->cv(PITCH).c_str()));
+        }
+        if (!cptr->cv(BEND_RANGE).empty()) {
+            midi_out->set_bend_range(atoi(cptr->cv(BEND_RANGE).c_str()));
+        }
+        for (int i = 0; i < inputs; i++) {
+            midi_out->add(pitch_trackers[i]);
+        }
+    }
+    // open the input, jack unless --source says otherwise
+    std::string spec = cptr->cv(SOURCE);
+    if (spec.empty() || spec == "jack") {
+        jt.set_session(cptr->cv(JACK_UUID), cptr->cv(JACK_INP));
+        jt.set_midi_out(midi_out);
+        jt.set_headless(headless_output != 0);
+        source      = &jt;
+    } else {
+        source      = AudioSource::create(spec, cptr->cv(PACING) == "fast");
+        if (!source) {
+            fprintf(stderr, "unknown source %s\n", spec.c_str());
+            return 1;
+        }
+        if (midi_out) {
+            fprintf(stderr, "--midi-out needs jack, ignored\n");
+        }
+    }
+    source->set_callbacks(wrap_pitch_tracker_add, wrap_source_finished, wrap_source_drained);
+    if (!source->open(inputs)) {
+        return 1;
+    }
+    wrap_set_max_period(source->period());
     // init gtk
-    gtk_init (&argc, &argv);
-    // activate jack
-    jt.gx_jack_activate(cptr->cv(JACK_UUID), cptr->cv(JACK_INP));
-    // start pitchtracker
-    pitch_tracker.init(static_cast<int>(jt.jack_sr),
-                                jack_client_thread_id(cptr->gc()));
-    // create window
-    tw.create_window();
-    // start thread to update the frequency
-    tw.g_threads    = g_timeout_add(
-        100, tw.gx_update_frequency, 0);
-    // run main programm
-    gtk_main ();
-    // stop pitch tracker thread
-    pitch_tracker.stop_thread();
+    if (!headless_output) {
+        gtk_init (&argc, &argv);
+    }
+    // jack knows its thread only once it is active, the other sources
+    // start after the trackers, as they feed them right away
+    if (source == &jt) {
+        source->start();
+    }
+    // start pitchtrackers, several inputs share one pool of threads, a
+    // fast source runs the analysis itself
+    if (pitch_trackers.size() > 1 && !source->fast()) {
+        tracker_pool = new TrackerPool;
+    }
+    for (unsigned int i = 0; i < pitch_trackers.size(); i++) {
+        setup_pitch_tracker(pitch_trackers[i]);
+        if (source->fast()) {
+            pitch_trackers[i]->set_threaded(false);
+        }
+        pitch_trackers[i]->set_new_freq(wrap_new_freq,
+                                        reinterpret_cast<void*>(static_cast<intptr_t>(i)));
+        if (tracker_pool) {
+            tracker_pool->add(pitch_trackers[i]);
+        }
+        if (headless_output) {
+            headless_output->add(pitch_trackers[i]);
+        }
+        pitch_trackers[i]->init(source->samplerate(), source->thread());
+    }
+    if (tracker_pool) {
+        tracker_pool->start(source->thread());
+    }
+    // the events of an estimate go out a hop and a period after its
+    // window, when the analysis is surely done
+    if (midi_out) {
+        midi_out->set_latency(pitch_trackers[0]->get_hop_frames() + source->period());
+    }
+    if (source != &jt) {
+        source->start();
+    }
+    if (headless_output) {
+        // write the estimates until a signal or the end of the input
+        headless_output->run();
+    } else {
+        // create window
+        tw.create_window();
+        // start thread to update the frequency
+        tw.g_threads    = g_timeout_add(
+            100, tw.gx_update_frequency, 0);
+        // run main programm
+        gtk_main ();
+    }
+    // nothing may feed the trackers any more
+    source->stop();
+    if (source != &jt) {
+        delete source;
+    }
+    // stop pitch tracker threads
+    delete tracker_pool;
+    for (unsigned int i = 0; i < pitch_trackers.size(); i++) {
+        pitch_trackers[i]->stop_thread();
+        delete pitch_trackers[i];
+    }
+    delete headless_output;
+    delete midi_out;
     // delete function pointer class pointer
     delete fptr;
     delete cptr;
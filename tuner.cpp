@@ -30,13 +30,11 @@
 #include "./resources.h"
 
 
-TunerWidget::TunerWidget() {}
+TunerWidget::TunerWidget() : update_stopped(false) {}
 TunerWidget::~TunerWidget() {}
 
 void TunerWidget::session_quit() {
-    jack_port_unregister(cptr->gc(), cptr->gp());
-    jack_deactivate(cptr->gc());
-    jack_client_close(cptr->gc());
+    cptr->cs();
     if (tw.g_threads > 0) {
         g_source_remove(tw.g_threads);
     }
@@ -44,9 +42,7 @@ void TunerWidget::session_quit() {
 }
 
 void TunerWidget::destroy( GtkWidget *widget, gpointer data) {
-    jack_port_unregister(cptr->gc(), cptr->gp());
-    jack_deactivate(cptr->gc());
-    jack_client_close(cptr->gc());
+    cptr->cs();
     if (tw.g_threads > 0) {
         g_source_remove(tw.g_threads);
     }
@@ -61,12 +57,36 @@ gboolean TunerWidget::delete_event(GtkWidget *widget, GdkEvent *event,
 gboolean TunerWidget::gx_update_frequency(gpointer arg) {
     gx_tuner_set_freq(GX_TUNER(tw.get_tuner()),
         cptr->ef());
+    // the tracker sleeps until the input gets above the threshold, so
+    // stop the timer as well, wake_up() starts it again. A wake_up()
+    // between the two checks takes the restart over.
+    if (cptr->ii()) {
+        tw.update_stopped.store(true);
+        if (cptr->ii() || !tw.update_stopped.exchange(false)) {
+            tw.g_threads = 0;
+            return false;
+        }
+    }
     return true;
 }
 
+gboolean TunerWidget::restart_update(gpointer arg) {
+    if (tw.g_threads == 0) {
+        tw.g_threads = g_timeout_add(100, gx_update_frequency, 0);
+    }
+    return false;
+}
+
+void TunerWidget::wake_up() {
+    if (update_stopped.exchange(false)) {
+        g_idle_add(restart_update, 0);
+    }
+}
+
 gboolean TunerWidget::ref_freq_changed(gpointer arg) {
     gx_tuner_set_reference_pitch(GX_TUNER(tw.get_tuner()),
         gtk_adjustment_get_value(GTK_ADJUSTMENT(arg)));
+    cptr->rf(gtk_adjustment_get_value(GTK_ADJUSTMENT(arg)));
     return true;
 }
 
@@ -89,6 +109,10 @@ gboolean TunerWidget::doremi_changed(gpointer arg) { //#1
     gx_tuner_set_doremi(GX_TUNER(tw.get_tuner()),N);
     return true;
 }
+gboolean TunerWidget::input_changed(gpointer arg) {
+    cptr->si(gtk_combo_box_get_active(GTK_COMBO_BOX(arg)));
+    return true;
+}
 gboolean TunerWidget::reference_note_changed(gpointer arg) {
     int R = gtk_combo_box_get_active(GTK_COMBO_BOX(arg));
     gx_tuner_set_reference_note(GX_TUNER(tw.get_tuner()),R);
@@ -218,6 +242,8 @@ void TunerWidget::create_window() {
     gtk_box_set_homogeneous(GTK_BOX(pcbox),false);
     qbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
     gtk_box_set_homogeneous(GTK_BOX(qbox),false);
+    rbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+    gtk_box_set_homogeneous(GTK_BOX(rbox),false);
     
         
     adj = gtk_adjustment_new(440, 200, 600, 0.1, 1.0, 0);
@@ -249,6 +275,15 @@ void TunerWidget::create_window() {
     gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(selectorq), NULL, "DoReMi");
     gtk_combo_box_set_active(GTK_COMBO_BOX(selectorq), 0);
     gtk_widget_set_opacity(GTK_WIDGET(selectorq), 0.4);
+    // active input, only shown with more than one jack input
+    selectorr = gtk_combo_box_text_new();
+    for (int i = 0; i < cptr->ni(); i++) {
+        std::string port = "in_" + std::to_string(i);
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(selectorr), NULL, port.c_str());
+    }
+    gtk_combo_box_set_active(GTK_COMBO_BOX(selectorr), 0);
+    gtk_widget_set_opacity(GTK_WIDGET(selectorr), 0.4);
+    gtk_widget_set_no_show_all(rbox, cptr->ni() < 2);
     // Reference note
     selectore = gtk_combo_box_text_new();
     gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(selectore), NULL, "F");
@@ -382,6 +417,7 @@ void TunerWidget::create_window() {
     gtk_widget_set_tooltip_text(GTK_WIDGET(spinnert),"threshold");
     gtk_widget_set_tooltip_text(GTK_WIDGET(selectord),"scale");
     gtk_widget_set_tooltip_text(GTK_WIDGET(selectorq),"CDE or DoReMi");
+    gtk_widget_set_tooltip_text(GTK_WIDGET(selectorr),"jack input");
     gtk_widget_set_tooltip_text(GTK_WIDGET(selectore),"Reference note");
     gtk_widget_set_tooltip_text(GTK_WIDGET(selectorf),"Flats or Sharps");
     gtk_widget_set_tooltip_text(GTK_WIDGET(selectorg),"Syncomma");
@@ -420,12 +456,14 @@ void TunerWidget::create_window() {
     gtk_container_add (GTK_CONTAINER (nbox), selectorn);
     gtk_container_add (GTK_CONTAINER (obox), selectoro);
     gtk_container_add (GTK_CONTAINER (qbox), selectorq);
+    gtk_container_add (GTK_CONTAINER (rbox), selectorr);
         
     //put all the filled boxes in hbox and pbox
     gtk_box_pack_start(GTK_BOX(hbox),habox,false,false,5);
         gtk_box_pack_start(GTK_BOX(habox),abox,false,false,5);
     gtk_box_pack_start(GTK_BOX(hbox),hbbox,false,false,5);
         gtk_box_pack_start(GTK_BOX(hbbox),cbox,true,false,5);
+        gtk_box_pack_start(GTK_BOX(hbbox),rbox,false,false,5);
         gtk_box_pack_start(GTK_BOX(hbbox),qbox,false,false,5);
         gtk_box_pack_start(GTK_BOX(hbbox),dbox,false,false,5);
         gtk_box_pack_start(GTK_BOX(hbbox),ebox,false,false,5);
@@ -456,6 +494,8 @@ void TunerWidget::create_window() {
         G_CALLBACK(mode_changed),(gpointer)selectord);
     g_signal_connect(GTK_COMBO_BOX(selectorq), "changed", //#2
         G_CALLBACK(doremi_changed),(gpointer)selectorq);
+    g_signal_connect(GTK_COMBO_BOX(selectorr), "changed",
+        G_CALLBACK(input_changed),(gpointer)selectorr);
     g_signal_connect(GTK_COMBO_BOX(selectore), "changed",
         G_CALLBACK(reference_note_changed),(gpointer)selectore);
     g_signal_connect(GTK_COMBO_BOX(selectorf), "changed",
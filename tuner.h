@@ -29,8 +29,7 @@
 #include <gtk/gtk.h>
 //#include <gtk/gtkprivate.h>
 
-#include <jack/jack.h>
-
+#include <atomic>
 #include <string> 
 #include <cmath>
 #include <cstdlib>
@@ -41,12 +40,16 @@ typedef std::string (*getcmdvar)
              (int x);
 typedef float (*getptvar)
              ();
-typedef jack_port_t* (*getport)
-             ();
-typedef jack_client_t* (*getclient)
+typedef void (*closesource)
              ();
 typedef void (*setptvar)
              (float x);
+typedef int (*getinputs)
+             ();
+typedef void (*setinput)
+             (int x);
+typedef bool (*getidle)
+             ();
 
 // the tuner widget class, add all functions and widget pointers 
 // used in the tuner class here.
@@ -86,6 +89,7 @@ class TunerWidget {
     GtkWidget*          pbbox;
     GtkWidget*          pcbox;
     GtkWidget*          qbox;
+    GtkWidget*          rbox;
     GtkWidget*          spinner;
     GtkWidget*          spinnert;
     GtkWidget*          selectord; //changes mode
@@ -101,6 +105,7 @@ class TunerWidget {
     GtkWidget*          selectorn; // 29comma
     GtkWidget*          selectoro; // 31comma
     GtkWidget*          selectorq; // doremi box, skipped p because this was already taken
+    GtkWidget*          selectorr; // active jack input
     
     static gboolean     delete_event(GtkWidget *widget, GdkEvent *event,
                              gpointer data);
@@ -108,6 +113,7 @@ class TunerWidget {
     static gboolean     threshold_changed(gpointer arg);
     static gboolean     mode_changed(gpointer arg);
     static gboolean     doremi_changed(gpointer arg); //#1
+    static gboolean     input_changed(gpointer arg);
     static gboolean     reference_note_changed(gpointer arg);
     static gboolean     reference_03comma_changed(gpointer arg);
     static gboolean     reference_05comma_changed(gpointer arg);
@@ -120,6 +126,9 @@ class TunerWidget {
     static gboolean     reference_29comma_changed(gpointer arg);
     static gboolean     reference_31comma_changed(gpointer arg);
     static void         destroy( GtkWidget *widget, gpointer data);
+    static gboolean     restart_update(gpointer arg);
+    // set when gx_update_frequency() has stopped its timer
+    std::atomic<bool>   update_stopped;
  public:
     explicit TunerWidget();
     ~TunerWidget();
@@ -136,16 +145,21 @@ class TunerWidget {
     }
     static void         signal_handler(int sig);
     static gboolean     gx_update_frequency(gpointer arg);
+    // start the frequency update again, from any thread
+    void                wake_up();
 };
 extern TunerWidget tw;
 
 class CmdPtr {
  public:
     getcmdvar           cv;
-    getport             gp;
-    getclient           gc;
+    closesource         cs;
     getptvar            ef;
     setptvar            sf;
+    setptvar            rf;
+    getinputs           ni;
+    setinput            si;
+    getidle             ii;
 };
 extern CmdPtr *cptr;
 